@@ -26,6 +26,10 @@ void loop() {
     uint32_t v = adc.read();
     uint32_t vcc = adc.measureVcc();
     int16_t temp = adc.measureTemp();
-    printf("ADC: %lu, vcc: %lumV temp: %dC\n", v, vcc, temp);
+    // the same using the hardware oversampler, 256 conversions each
+    uint32_t vcc16 = adc.measureVcc(256);
+    int16_t temp16 = adc.measureTemp(256);
+    printf("ADC: %lu, vcc: %lumV temp: %dC, oversampled vcc: %lumV temp: %dC\n",
+            v, vcc, temp, vcc16, temp16);
     delay(1000);
 }
@@ -4,8 +4,8 @@
 #include <Arduino.h>
 #include <Wire.h>
 #include "MCP9808.h"
-//#include "STM32ADC.h"
-#include "STM32L0.h"
+#include "STM32Stop.h"
+#include "STM32ADC.h"
 
 #define LED LED_BUILTIN
 
@@ -19,26 +19,48 @@ static uint16_t blinks = 200; // number of times to blink LED for ack before goi
 static uint16_t vMin = 0; // minimum battery voltage measured
 static uint16_t vStart = 0; // battery voltage measured when coming out of sleep
 
+// Sensing runs in the low-power clock profile, radio work in the full-speed one. Setting
+// MEASURE_PROFILES alternates the sensing profile on each cycle and logs the awake time and
+// estimated charge per cycle so the two can be compared.
+#ifndef MEASURE_PROFILES
+#define MEASURE_PROFILES 0
+#endif
+static ClockProfile sensingProfile = CLOCK_PROFILE_LOW_POWER;
+static constexpr uint32_t profileUA[] = { 6000, 350 }; // run current estimate per ClockProfile
+// I2C speed per ClockProfile: I2C1 runs off PCLK1, and at 2.1MHz that only supports standard mode
+static constexpr uint32_t profileI2cHz[] = { 400000, 100000 };
+
 //===== Hardware devices
 
-MCP9808 tempSensor(Wire, 0x18);
-//STM32ADC adc(ADC1);
+MCP9808Arduino tempRegs(Wire, 0x18);
+MCP9808 tempSensor(tempRegs);
+STM32Stop lowPower;
+STM32ADC adc(ADC1);
+
+extern "C" volatile uint32_t uwTick; // HAL millisecond counter behind millis()
 
 //===== Utility functions
 
-// batVoltage returns the battery voltage in mV
-static int batVoltage () {
-    return (int)(STM32L0.getVBAT()*1000+0.5);
+// useProfile switches the clock profile and re-initializes the peripherals that depend on it, it
+// does nothing when the profile is already in use.
+static void useProfile (ClockProfile profile) {
+    if (profile == GetClockProfile()) return;
+    SetClockProfile(profile);
+    Wire.setClock(profileI2cHz[profile]); // recompute I2C timing for the new clock
+    adc.updateClock();
 }
-#if 0
-    adc.startConversion();
-    int32_t raw = adc.read();
-    adc.startConversion();
-    raw += adc.read();
-    int32_t vcc = (adc.measureVcc() + adc.measureVcc()) / 2;
-    return (raw * vcc) / 4095;  // result in mV, with 1:2 divider
+
+static int16_t uCTemp; // uC temperature measured along with the battery voltage
+
+// batVoltage returns the battery voltage in mV, it converts the battery pin, Vrefint and the
+// temperature sensor in one scan and also updates uCTemp. The same scan tells whether the ADC
+// calibration drifted with the battery or the temperature.
+static int batVoltage () {
+    STM32ADC::Measurement m = adc.measure<PB_1>(); // VBAT_PIN
+    adc.checkCalibration(m);
+    uCTemp = m.temp;
+    return m.mV * 2; // 1:2 divider
 }
-#endif
 
 #if 0
 static bool sendPkt(int data[], int n) {
@@ -78,12 +100,11 @@ void setup() {
 
     // init I2C and temperature sensor
     Wire.begin();
-    Wire.setClock(400000);
+    Wire.setClock(profileI2cHz[GetClockProfile()]);
     if (!tempSensor.init()) {
         Serial.println("OOPS, can't init MCP9808!");
         while(1) ;
     }
-    tempSensor.convert(); // flashing of LED is enough delay after enable
 
 #if 0
     spi.init();
@@ -93,8 +114,15 @@ void setup() {
     }
 #endif
 
-    //pinMode(VBAT_PIN, INPUT);
-    //adc.begin(VBAT_PIN);
+    adc.begin<PB_1>(); // VBAT_PIN, resolved at compile time, also sets it to analog mode
+
+    // STOP mode between readings, the clock profile needs to be restored on wake-up
+    lowPower.restoreClock = RestoreClockProfile;
+    lowPower.begin();
+    lowPower.calibrate(millis);
+    lowPower.measureLatency();
+    printf("LSI: %luHz, wake-up latency: %luus, clock restored: %luus\n",
+            lowPower.hz, lowPower.wakeUs, lowPower.restoreUs);
 
     // blink 3x to signify end of setup, leave LED off
     for (int i=0; i<5; i++) { digitalWrite(LED, 1-digitalRead(LED)); delay(200); }
@@ -108,15 +136,21 @@ void setup() {
 //===== Loop
 
 void loop() {
+    uint32_t startUs = micros();
+    useProfile(sensingProfile);
+    uint32_t convMs = tempSensor.start();
+    uint32_t wokeAt = millis();
     vStart = batVoltage();
     if (vStart < vMin) vMin = vStart;
-    int16_t uCTemp = (int16_t)(STM32L0.getTemperature() + 0.5);
-    int32_t t = tempSensor.read();
+    uint32_t elapsed = millis() - wokeAt;
+    if (elapsed < convMs) delay(convMs - elapsed);
+    int32_t t = tempSensor.finish();
     //Serial.println("Loop");
     printf("vBat: %d.%03dV->%d.%03dV uC:%dC mcp:%ld.%02ldC\r\n",
             vStart/1000, vStart%1000, vMin/1000, vMin%1000, uCTemp, t/100, t%100);
 
 #if 0
+    useProfile(CLOCK_PROFILE_FULL_SPEED); // SPI-heavy radio work is done sooner at 32MHz
     int data[8] = { t, 0, 0, 0, rf.txPow(), uCTemp, vStart, vMin };
     if (sendPkt(data, 8)) {
         if (blinks > 0) {
@@ -128,8 +162,21 @@ void loop() {
     } else {
         printf("no-ack\r\n");
     }
+    useProfile(sensingProfile);
 #endif
     vMin = batVoltage();
 
-    delay(2000);
+    uint32_t awakeUs = micros() - startUs;
+#if MEASURE_PROFILES
+    // charge in pAh: 1uA for 1us is 1/3600 pAh
+    uint32_t pAh = (uint64_t)profileUA[sensingProfile] * awakeUs / 3600;
+    printf("profile %s: awake %luus, %lupAh, avg %luuA at %ds\r\n",
+            sensingProfile == CLOCK_PROFILE_LOW_POWER ? "low-power" : "full-speed", awakeUs, pAh,
+            STM32Stop::avgCurrent(2000, awakeUs/1000, profileUA[sensingProfile], 0, 2)/1000, 2);
+    sensingProfile = sensingProfile == CLOCK_PROFILE_LOW_POWER ?
+            CLOCK_PROFILE_FULL_SPEED : CLOCK_PROFILE_LOW_POWER;
+#endif
+
+    Serial.flush();
+    uwTick += lowPower.stop(2000); // SysTick doesn't run in STOP mode
 }
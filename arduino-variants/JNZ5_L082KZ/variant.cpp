@@ -54,6 +54,7 @@ WEAK void SystemClock_Config(void)
   __HAL_RCC_PWR_CLK_ENABLE();
 
   __HAL_PWR_VOLTAGESCALING_CONFIG(PWR_REGULATOR_VOLTAGE_SCALE1);
+  while (__HAL_PWR_GET_FLAG(PWR_FLAG_VOS)) ; // needed when coming from a lower voltage scale
 
   RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_HSI;
   RCC_OscInitStruct.HSIState = RCC_HSI_ON;
@@ -85,6 +86,119 @@ WEAK void SystemClock_Config(void)
   HAL_NVIC_SetPriority(SysTick_IRQn, 0, 0);
 }
 
+static ClockProfile clockProfile = CLOCK_PROFILE_FULL_SPEED;
+
+/**
+  * @brief  Switch the system clock to MSI range 5 (2.1MHz) at voltage scale 3 and turn the PLL
+  *         and HSI16 off. Flash runs with zero wait states.
+  * @param  None
+  * @retval None
+  */
+static void LowPowerClock_Config(void)
+{
+  RCC_OscInitTypeDef RCC_OscInitStruct;
+  RCC_ClkInitTypeDef RCC_ClkInitStruct;
+
+  RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_MSI;
+  RCC_OscInitStruct.MSIState = RCC_MSI_ON;
+  RCC_OscInitStruct.MSICalibrationValue = RCC_MSICALIBRATION_DEFAULT;
+  RCC_OscInitStruct.MSIClockRange = RCC_MSIRANGE_5;
+  RCC_OscInitStruct.PLL.PLLState = RCC_PLL_NONE;
+  HAL_RCC_OscConfig(&RCC_OscInitStruct);
+
+  RCC_ClkInitStruct.ClockType = RCC_CLOCKTYPE_HCLK|RCC_CLOCKTYPE_SYSCLK
+                              |RCC_CLOCKTYPE_PCLK1|RCC_CLOCKTYPE_PCLK2;
+  RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_MSI;
+  RCC_ClkInitStruct.AHBCLKDivider = RCC_SYSCLK_DIV1;
+  RCC_ClkInitStruct.APB1CLKDivider = RCC_HCLK_DIV1;
+  RCC_ClkInitStruct.APB2CLKDivider = RCC_HCLK_DIV1;
+  HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_0);
+
+  // PLL and HSI16 are no longer needed
+  RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_HSI;
+  RCC_OscInitStruct.HSIState = RCC_HSI_OFF;
+  RCC_OscInitStruct.PLL.PLLState = RCC_PLL_OFF;
+  HAL_RCC_OscConfig(&RCC_OscInitStruct);
+
+  // lower the core voltage only after the clock is down
+  __HAL_PWR_VOLTAGESCALING_CONFIG(PWR_REGULATOR_VOLTAGE_SCALE3);
+  while (__HAL_PWR_GET_FLAG(PWR_FLAG_VOS)) ;
+
+  HAL_SYSTICK_Config(HAL_RCC_GetHCLKFreq()/1000);
+  HAL_SYSTICK_CLKSourceConfig(SYSTICK_CLKSOURCE_HCLK);
+}
+
+/**
+  * @brief  Re-program the baud rate divider of the USARTs that are enabled so they keep their
+  *         baud rate across a change of PCLK. Waits for any transmission in progress to complete.
+  * @param  pclk1Old, pclk2Old: the APB clocks before the change
+  * @retval None
+  */
+static void UsartClock_Update(uint32_t pclk1Old, uint32_t pclk2Old)
+{
+  USART_TypeDef *usarts[] = { USART1, USART2 };
+  uint32_t oldClk[] = { pclk2Old, pclk1Old };
+  uint32_t newClk[] = { HAL_RCC_GetPCLK2Freq(), HAL_RCC_GetPCLK1Freq() };
+  for (int i=0; i<2; i++) {
+    USART_TypeDef *u = usarts[i];
+    if ((u->CR1 & USART_CR1_UE) == 0 || u->BRR == 0) continue;
+    uint32_t baud = oldClk[i] / u->BRR;
+    u->CR1 &= ~USART_CR1_UE; // BRR can only be written when disabled
+    u->BRR = (newClk[i] + baud/2) / baud;
+    u->CR1 |= USART_CR1_UE;
+  }
+}
+
+static void UsartIdle_Wait(void)
+{
+  USART_TypeDef *usarts[] = { USART1, USART2 };
+  for (int i=0; i<2; i++) {
+    USART_TypeDef *u = usarts[i];
+    if ((u->CR1 & USART_CR1_UE) == 0) continue;
+    while ((u->ISR & USART_ISR_TC) == 0) ;
+  }
+}
+
+/**
+  * @brief  Switch between the full-speed (32MHz PLL) and the low-power (2.1MHz MSI) clock
+  *         profile. SysTick and the USART baud rates are updated, the ADC and I2C must be
+  *         re-initialized by the caller (STM32ADC::updateClock() and Wire.setClock()). I2C1
+  *         runs off PCLK1, at 2.1MHz it only supports standard mode (100kHz).
+  * @param  profile: the clock profile to switch to
+  * @retval None
+  */
+void SetClockProfile(ClockProfile profile)
+{
+  if (profile == clockProfile) return;
+  uint32_t pclk1 = HAL_RCC_GetPCLK1Freq(), pclk2 = HAL_RCC_GetPCLK2Freq();
+  UsartIdle_Wait();
+  if (profile == CLOCK_PROFILE_LOW_POWER) {
+    LowPowerClock_Config();
+  } else {
+    SystemClock_Config(); // raises the core voltage before switching to the PLL
+  }
+  clockProfile = profile;
+  UsartClock_Update(pclk1, pclk2);
+}
+
+ClockProfile GetClockProfile(void)
+{
+  return clockProfile;
+}
+
+/**
+  * @brief  Restore the current clock profile, e.g. after waking up from STOP mode.
+  * @param  None
+  * @retval None
+  */
+void RestoreClockProfile(void)
+{
+  if (clockProfile == CLOCK_PROFILE_LOW_POWER)
+    LowPowerClock_Config();
+  else
+    SystemClock_Config();
+}
+
 #ifdef __cplusplus
 }
 #endif
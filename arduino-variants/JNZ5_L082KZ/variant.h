@@ -57,6 +57,17 @@ extern const PinName digitalPin[];
 #define PIN_WIRE_SDA            PB7
 #define PIN_WIRE_SCL            PB6
 
+// System clock configuration, also used to restore the clock after waking up from STOP mode
+void SystemClock_Config(void);
+
+// Clock profiles: full speed runs at 32MHz off HSI16+PLL at voltage scale 1 for SPI-heavy radio
+// work, low power runs at 2.1MHz off MSI at voltage scale 3 for sensing and idling. Switching
+// updates SysTick and the USART baud rates; the ADC and I2C need to be re-initialized.
+typedef enum { CLOCK_PROFILE_FULL_SPEED, CLOCK_PROFILE_LOW_POWER } ClockProfile;
+void SetClockProfile(ClockProfile profile);
+ClockProfile GetClockProfile(void);
+void RestoreClockProfile(void); // re-apply the current profile after STOP mode
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -0,0 +1,232 @@
+// replay feeds a trace of readings through the reporting logic of the rf69temp node and the
+// reconstruction done by the waterfall2 monitor, and reports the transmissions compared to plain
+// send-on-delta at the same bounds as well as how closely the gateway tracks the readings.
+//
+// Build and run on Linux from this directory:
+//   g++ -O2 -I../src replay.cpp ../src/DualPredict.cpp -o replay && ./replay
+// or with arguments: ./replay [trace [ack% [sniff% [heartbeat]]]]
+//
+// The trace has one reading per line, as taken every `rate` seconds: the temperature in 1/100 C
+// and optionally the battery voltage in mV, lines starting with # are skipped. The rf69temp
+// console output can be turned into a trace by extracting the mcp: and vBat: values. Without a
+// trace (or with "-") a synthetic one is used: three days of a daily 5C swing, quantized to the
+// MCP9808's 0.125C, and a slowly draining battery with some ADC noise.
+//
+// ack% is the percentage of reports for which the node gets no ACK, sniff% the percentage of
+// reports the monitor misses. heartbeat defaults to rf69temp's 15 readings, it puts a floor under
+// the number of reports of both schemes, 0 disables it.
+//
+// The monitor is replayed twice, once checking the sequence numbers as waterfall2 does, and once
+// naively applying every residual it receives. A report the monitor applies must reconstruct the
+// reading exactly, the exit status is non-zero if the checking monitor ever got one wrong. In
+// between reports the monitor's prediction is within the bound unless it missed a report, which
+// it cannot know until the next one arrives.
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "DualPredict.h"
+
+// parameters mirroring rf69temp, in readings rather than seconds
+static const int32_t tBound = 20;       // 1/100 C
+static const int32_t vBound = 50;       // mV
+static int heartbeat = 15;              // readings between reports at the latest
+static const uint8_t resyncEvery = 16;  // reports between absolute values
+
+static const int maxReadings = 100000;
+static int32_t temps[maxReadings], volts[maxReadings];
+
+// Report is the content of a type 3 packet that matters for the reconstruction.
+struct Report {
+    uint16_t steps; // 0 for absolute values
+    int32_t t, v;   // residuals or absolute values
+    uint8_t seq;
+};
+
+// Node implements the reporting of rf69temp.
+struct Node {
+    DualPredict tPred, vPred;
+    uint16_t steps = 0;
+    bool resync = true;
+    uint8_t seq = 0;
+
+    // reading returns true if the reading needs to be reported and fills in the report
+    bool reading (int32_t t, int32_t v, Report& r) {
+        steps++;
+        int32_t tr = tPred.residual(steps, t), vr = vPred.residual(steps, v);
+        if (!resync && tr < tBound && tr > -tBound && vr < vBound && vr > -vBound
+                && (heartbeat == 0 || steps < heartbeat))
+            return false;
+        r.steps = resync ? 0 : steps;
+        r.t = resync ? t : tr;
+        r.v = resync ? v : vr;
+        r.seq = seq++;
+        return true;
+    }
+
+    // acked moves the predictors forward once the gateway acknowledged the report
+    void acked (const Report& r) {
+        if (r.steps == 0) {
+            tPred.reset(r.t);
+            vPred.reset(r.v);
+        } else {
+            tPred.update(r.steps, r.t);
+            vPred.update(r.steps, r.v);
+        }
+        steps = 0;
+        resync = seq % resyncEvery == 0;
+    }
+};
+
+// Monitor implements the reconstruction of the waterfall2 monitor. It tracks the reading index of
+// the anchor so the replay can compare the value it would show at every reading.
+struct Monitor {
+    bool checkSeq;
+    DualPredict tPred, vPred;
+    uint8_t nextSeq = 0;
+    bool synced = false;
+    int anchorAt = 0;
+    int losses = 0;
+
+    Monitor (bool check) : checkSeq(check) {}
+
+    void report (const Report& r, int at, int32_t t, int32_t v) {
+        int32_t rt, rv;
+        if (r.steps == 0) {
+            tPred.reset(rt = r.t);
+            vPred.reset(rv = r.v);
+            synced = true;
+        } else if (!checkSeq || (synced && r.seq == nextSeq)) {
+            if (!synced) return; // naive monitor started mid-stream
+            rt = tPred.update(r.steps, r.t);
+            rv = vPred.update(r.steps, r.v);
+        } else {
+            if (synced) losses++;
+            synced = false;
+            return;
+        }
+        nextSeq = r.seq + 1;
+        anchorAt = at;
+        stats.applied++;
+        if (rt != t || rv != v) stats.wrong++;
+    }
+
+    // Stats accumulates how far the monitor's view is off from the actual readings.
+    struct Stats {
+        int applied = 0, wrong = 0; // reports applied, and those reconstructed incorrectly
+        int synced = 0, beyond = 0; // readings in sync, and those off by more than the bound
+        int32_t tMax = 0, vMax = 0;
+    } stats;
+
+    void check (int at, int32_t t, int32_t v) {
+        if (!synced) return;
+        int32_t te = labs(tPred.predict(at - anchorAt) - t);
+        int32_t ve = labs(vPred.predict(at - anchorAt) - v);
+        stats.synced++;
+        if (te > stats.tMax) stats.tMax = te;
+        if (ve > stats.vMax) stats.vMax = ve;
+        if (te > tBound || ve > vBound) stats.beyond++;
+    }
+};
+
+// chance returns true with the given probability in percent, deterministically.
+static bool chance (uint32_t& rnd, double pct) {
+    rnd = rnd * 1103515245 + 12345;
+    return (rnd >> 8) % 10000 < pct * 100;
+}
+
+static int synthetic () {
+    uint32_t rnd = 1;
+    int n = 3 * 1440;
+    for (int i=0; i<n; i++) {
+        double c = 2000 + 500 * sin(2 * M_PI * i / 1440);
+        temps[i] = (int32_t)lround(c * 8 / 100) * 100 / 8; // 0.125C resolution
+        rnd = rnd * 1103515245 + 12345;
+        volts[i] = 3300 - i / 100 + (int32_t)((rnd >> 16) % 21) - 10;
+    }
+    return n;
+}
+
+static int load (const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) { perror(path); exit(2); }
+    char line[128];
+    int n = 0;
+    while (n < maxReadings && fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') continue;
+        int t, v;
+        int k = sscanf(line, "%d %d", &t, &v);
+        if (k < 1) continue;
+        temps[n] = t;
+        volts[n] = k == 2 ? v : 3300;
+        n++;
+    }
+    fclose(f);
+    return n;
+}
+
+int main(int argc, char** argv) {
+    int n = argc > 1 && argv[1][0] != '-' ? load(argv[1]) : synthetic();
+    double ackLoss = argc > 2 ? atof(argv[2]) : 0;
+    double sniffLoss = argc > 3 ? atof(argv[3]) : 0;
+    if (argc > 4) heartbeat = atoi(argv[4]);
+    if (n == 0) { fprintf(stderr, "empty trace\n"); return 2; }
+
+    Node node;
+    Monitor checking(true), naive(false);
+    uint32_t rndAck = 1, rndSniff = 2;
+    int sent = 0, acks = 0, sniffed = 0;
+
+    // send-on-delta baseline: report when a value moved by the bound since the last report
+    uint32_t rndDelta = 1;
+    int deltaSent = 0, sinceDelta = 0;
+    int32_t tLast = 0, vLast = 0;
+    bool deltaSync = true;
+
+    for (int i=0; i<n; i++) {
+        Report r;
+        if (node.reading(temps[i], volts[i], r)) {
+            sent++;
+            if (!chance(rndSniff, sniffLoss)) {
+                sniffed++;
+                checking.report(r, i, temps[i], volts[i]);
+                naive.report(r, i, temps[i], volts[i]);
+            }
+            if (!chance(rndAck, ackLoss)) {
+                acks++;
+                node.acked(r);
+            } else {
+                node.resync = true;
+            }
+        }
+        checking.check(i, temps[i], volts[i]);
+        naive.check(i, temps[i], volts[i]);
+
+        sinceDelta++;
+        if (deltaSync || labs(temps[i] - tLast) >= tBound || labs(volts[i] - vLast) >= vBound
+                || (heartbeat > 0 && sinceDelta >= heartbeat)) {
+            deltaSent++;
+            deltaSync = chance(rndDelta, ackLoss);
+            if (!deltaSync) {
+                tLast = temps[i];
+                vLast = volts[i];
+                sinceDelta = 0;
+            }
+        }
+    }
+
+    printf("%d readings, bounds %d.%02dC %dmV, heartbeat %d, %.1f%% ACKs lost, %.1f%% sniffs lost\n",
+            n, tBound/100, tBound%100, vBound, heartbeat, ackLoss, sniffLoss);
+    printf("dual-prediction: %d reports (%.1f%%), %d ACKed, %d sniffed\n",
+            sent, 100.0 * sent / n, acks, sniffed);
+    printf("send-on-delta:   %d reports (%.1f%%)\n", deltaSent, 100.0 * deltaSent / n);
+    const Monitor* mons[] = { &checking, &naive };
+    const char* names[] = { "checking seq", "naive" };
+    for (int m=0; m<2; m++) {
+        const Monitor::Stats& s = mons[m]->stats;
+        printf("monitor, %s: %d reports applied, %d wrong, %d losses detected\n",
+                names[m], s.applied, s.wrong, mons[m]->losses);
+        printf("  in sync for %d readings, max error %d.%02dC %dmV, %d readings beyond bound\n",
+                s.synced, s.tMax/100, s.tMax%100, s.vMax, s.beyond);
+    }
+    return checking.stats.wrong ? 1 : 0;
+}
@@ -0,0 +1,27 @@
+// Dual-prediction for telemetry, see DualPredict.h
+#include "DualPredict.h"
+
+void DualPredict::reset (int32_t v) {
+    _anchor = v;
+    _slope = 0;
+    _count = 0;
+}
+
+int32_t DualPredict::predict (uint16_t n) const {
+    int64_t d = (int64_t)_slope * n;
+    return _anchor + (int32_t)((d + (d < 0 ? -128 : 128)) / 256); // round to nearest
+}
+
+// update computes the trend between the anchor and the reconstructed value. The first trend after
+// a reset is taken as-is, subsequent ones are averaged with the previous trend to keep noise
+// from being extrapolated.
+int32_t DualPredict::update (uint16_t n, int32_t r) {
+    int32_t v = predict(n) + r;
+    if (n > 0) {
+        int32_t slope = (int32_t)((int64_t)(v - _anchor) * 256 / n);
+        _slope = _count == 0 ? slope : (_slope + slope) / 2;
+        if (_count < 255) _count++;
+    }
+    _anchor = v;
+    return v;
+}
@@ -0,0 +1,41 @@
+// Dual-prediction for telemetry: the sensor node and the gateway run the same deterministic
+// predictor on the same reconstructed values, so the node only needs to transmit when the
+// prediction is off by more than a bound, and then only the residual.
+//
+// The predictor extrapolates a linear trend from the last reconstructed value (the anchor). The
+// node counts the reading intervals ("steps") since the anchor and sends the count along with the
+// residuals so the gateway does not need to keep time. All arithmetic is integer so both sides
+// produce bit-identical predictions.
+//
+// Protocol: the node resets the predictor and sends absolute values at start-up and after a
+// missed ACK, since it cannot know whether the gateway applied the lost update. Otherwise it
+// calls update() only once the gateway has acknowledged the residuals. A receiver that is not the
+// one ACKing, e.g., a sniffer, can miss an update the node considers delivered, so reports carry
+// a sequence number and the node periodically sends absolute values for such receivers to resync.
+//
+// The extras/replay.cpp host program replays a trace through a node and a gateway and reports the
+// transmissions saved compared to send-on-delta as well as the reconstruction error.
+#ifndef _DUALPREDICT_
+#define _DUALPREDICT_
+
+#include <stdint.h>
+
+struct DualPredict {
+    // reset restarts the predictor from an absolute value with a flat trend
+    void reset (int32_t v);
+    // predict returns the value expected n steps after the anchor
+    int32_t predict (uint16_t n) const;
+    // residual returns the difference between an actual value n steps after the anchor and its
+    // prediction
+    int32_t residual (uint16_t n, int32_t v) const { return v - predict(n); }
+    // update applies a residual received/sent n steps after the anchor, making the reconstructed
+    // value the new anchor and refining the trend; it returns the reconstructed value
+    int32_t update (uint16_t n, int32_t r);
+
+    //private:
+    int32_t _anchor; // last reconstructed value
+    int32_t _slope;  // trend in value units per step, with 8 fractional bits
+    uint8_t _count;  // updates since reset, saturates
+};
+
+#endif
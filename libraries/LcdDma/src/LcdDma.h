@@ -0,0 +1,141 @@
+// DMA pixel push for SPI-attached LCDs on the STM32F1 with JeeH
+//
+// The JeeH ILI9341 and ILI9325 drivers push pixels with one SPI transfer per byte, so the CPU is
+// busy for the entire row. LcdDma starts a row through the driver, which sets the window and
+// starts the memory write, and then has DMA send the remaining pixels in the background. The
+// SPI is switched to 16-bit frames for that, which go out MSB first as the LCD expects, so the
+// rgb565 row buffer is sent as-is. The row buffer must not be modified until the transfer is
+// done, i.e., the caller alternates between two buffers and calls wait() before touching the
+// LCD again.
+//
+// DMA requires a hardware SPI, for a bit-banged SpiGpio use LcdPush, which has the same
+// interface and pushes synchronously. JeeH's SpiHw always uses SPI1, LcdSpiHw below does the same
+// for SPI1 or SPI2. The application routes the DMA interrupt, e.g., for SPI2:
+// extern "C" void dma1_channel5_isr () { LcdRow::irq(); }
+#ifndef _LCDDMA_
+#define _LCDDMA_
+
+#include <stdint.h>
+#include <jee.h>
+
+// LcdPush pushes pixels synchronously using the driver, for LCDs on a bit-banged SPI.
+template< typename LCD >
+struct LcdPush {
+    static void init () {}
+    static void pixels (int x, int y, uint16_t const* rgb, int len) {
+        LCD::pixels(x, y, rgb, len);
+    }
+    static bool busy () { return false; }
+    static void wait () {}
+};
+
+// LcdSpiHw is JeeH's SpiHw for the SPI at spiBase, 0x40013000 for SPI1 on APB2 or 0x40003800 for
+// SPI2 on APB1, running at a quarter of the bus clock, e.g., 9MHz for SPI2 at 72MHz.
+template< typename MO, typename MI, typename CK, typename SS, uint32_t spiBase, int CP =0 >
+struct LcdSpiHw {
+    constexpr static uint32_t cr1 = spiBase + 0x00;
+    constexpr static uint32_t sr  = spiBase + 0x08;
+    constexpr static uint32_t dr  = spiBase + 0x0C;
+
+    static void init () {
+        MO::mode(Pinmode::alt_out);
+        MI::mode(Pinmode::in_float);
+        CK::mode(Pinmode::alt_out);
+        SS::mode(Pinmode::out);
+        disable();
+
+        if (spiBase == 0x40013000)
+            MMIO32(0x40021018) |= 1 << 12; // SPI1EN in RCC_APB2ENR
+        else
+            MMIO32(0x4002101C) |= 1 << 14; // SPI2EN in RCC_APB1ENR
+        // SSM, SSI, SPE, BR=fPCLK/4, MSTR
+        MMIO32(cr1) = (1<<9) | (1<<8) | (1<<6) | (1<<3) | (1<<2) | (CP<<0);
+    }
+
+    static void enable () { SS::write(0); }
+    static void disable () { while (MMIO32(sr) & (1<<7)) {} SS::write(1); }
+
+    static uint8_t transfer (uint8_t v) {
+        MMIO32(dr) = v;
+        while ((MMIO32(sr) & (1<<0)) == 0) {}
+        return MMIO32(dr);
+    }
+};
+
+// LcdDma pushes pixels using DMA1 on the SPI at spiBase, i.e., 0x40013000 for SPI1 or 0x40003800
+// for SPI2. startByte, if not negative, is sent at the start of the data transfer, the ILI9325
+// in SPI mode needs 0x72 there.
+template< typename LCD, typename SPI, uint32_t spiBase, int startByte =-1 >
+struct LcdDma {
+    // DMA1 channel serving the SPI's TX requests, and its interrupt
+    constexpr static int chan = spiBase == 0x40013000 ? 3 : 5;
+    constexpr static int irqn = spiBase == 0x40013000 ? 13 : 15;
+
+    constexpr static uint32_t dma  = 0x40020000;
+    constexpr static uint32_t ifcr = dma + 0x04;
+    constexpr static uint32_t ccr  = dma + 0x08 + 20*(chan-1);
+    constexpr static uint32_t cndtr= ccr + 0x04;
+    constexpr static uint32_t cpar = ccr + 0x08;
+    constexpr static uint32_t cmar = ccr + 0x0C;
+
+    constexpr static uint32_t cr1 = spiBase + 0x00;
+    constexpr static uint32_t cr2 = spiBase + 0x04;
+    constexpr static uint32_t sr  = spiBase + 0x08;
+    constexpr static uint32_t dr  = spiBase + 0x0C;
+
+    // init enables the DMA clock and interrupt, the SPI must have been initialized.
+    static void init () {
+        MMIO32(0x40021014) |= 1 << 0; // DMA1EN in RCC_AHBENR
+        MMIO32(0xE000E100) = 1 << irqn; // NVIC_ISER
+    }
+
+    // pixels starts pushing a row of pixels and returns once the DMA is running.
+    static void pixels (int x, int y, uint16_t const* rgb, int len) {
+        wait();
+        LCD::pixel(x, y, rgb[0]); // sets the window and starts the memory write
+        if (len <= 1) return;
+        SPI::enable();
+        if (startByte >= 0) SPI::transfer(startByte);
+        while (MMIO32(sr) & (1<<7)) {} // BSY
+        MMIO32(cr1) &= ~(1<<6); // SPE off to change the frame format
+        MMIO32(cr1) |= (1<<11) | (1<<6); // DFF: 16-bit frames
+        MMIO32(ccr) = 0;
+        MMIO32(cpar) = dr;
+        MMIO32(cmar) = (uint32_t) (uintptr_t) (rgb + 1);
+        MMIO32(cndtr) = len - 1;
+        busyFlag = true;
+        // MSIZE=16, PSIZE=16, MINC, DIR=from memory, TCIE, EN
+        MMIO32(ccr) = (1<<10) | (1<<8) | (1<<7) | (1<<4) | (1<<1) | (1<<0);
+        MMIO32(cr2) |= 1<<1; // TXDMAEN
+    }
+
+    // irq finishes a transfer, it is called by the DMA interrupt handler.
+    static void irq () {
+        MMIO32(ifcr) = 0xF << 4*(chan-1);
+        MMIO32(ccr) = 0;
+        MMIO32(cr2) &= ~(1<<1);
+        while ((MMIO32(sr) & (1<<1)) == 0 || (MMIO32(sr) & (1<<7))) {} // TXE and not BSY
+        MMIO32(cr1) &= ~(1<<6);
+        MMIO32(cr1) &= ~(1<<11); // back to 8-bit frames for the driver
+        MMIO32(cr1) |= 1<<6;
+        (void) MMIO32(dr); // drop the stale RX data and clear the overrun flag
+        (void) MMIO32(sr);
+        SPI::disable();
+        busyFlag = false;
+    }
+
+    static bool busy () { return busyFlag; }
+
+    // wait waits for the current transfer to finish, after which the LCD may be used again.
+    static void wait () {
+        while (busyFlag)
+            __asm("wfi");
+    }
+
+    static volatile bool busyFlag;
+};
+
+template< typename LCD, typename SPI, uint32_t spiBase, int startByte >
+volatile bool LcdDma<LCD, SPI, spiBase, startByte>::busyFlag;
+
+#endif
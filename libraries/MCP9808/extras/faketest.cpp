@@ -0,0 +1,114 @@
+// Host test for the MCP9808 driver using the MCP9808Fake register emulation. It checks the
+// temperature conversion including negative values and resolutions, the one-shot sequence, the
+// background read path including a failed read, and the limit registers that drive the ALERT
+// output.
+//
+// Build and run on Linux from this directory:
+//   g++ -O2 -I../src faketest.cpp ../src/MCP9808.cpp -o faketest && ./faketest
+#include <stdio.h>
+#include "MCP9808.h"
+
+static int fails;
+
+#define CHECK(cond) do { if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+    fails++; } } while (0)
+
+static uint32_t slept; // total ms passed to the delay function
+static void fakeDelay (uint32_t ms) { slept += ms; }
+
+int main() {
+    MCP9808Fake regs;
+    MCP9808 sensor(regs);
+
+    // init checks the ids, shuts the device down and sets the default 0.125C resolution
+    CHECK(sensor.init());
+    CHECK(regs._regs[1] == 0x100);
+    CHECK(regs._regs[8] == MCP9808::RES_0_125C);
+
+    // conversion from the register format, truncated to the resolution like the device does
+    regs.temp = 2345;
+    CHECK(sensor.read() == 2338); // 23.375C
+    sensor.resolution(MCP9808::RES_0_0625C);
+    CHECK(sensor.read() == 2344); // 23.4375C
+    sensor.resolution(MCP9808::RES_0_5C);
+    CHECK(sensor.read() == 2300);
+    regs.temp = -1050;
+    CHECK(sensor.read() == -1050);
+    regs.temp = -1;
+    CHECK(sensor.read() == -50); // rounds towards -inf at 0.5C resolution
+    regs.temp = 0;
+    CHECK(sensor.read() == 0);
+
+    // resolution only writes the device when it changes
+    int w = regs.nWrite;
+    sensor.resolution(MCP9808::RES_0_5C);
+    CHECK(regs.nWrite == w);
+    sensor.resolution(MCP9808::RES_KEEP);
+    CHECK(regs.nWrite == w);
+
+    // one-shot: wake up with the requested resolution, wait tCONV, read and shut down again
+    regs.temp = 1812;
+    slept = 0;
+    int32_t t = sensor.oneShot(fakeDelay, MCP9808::RES_0_25C);
+    CHECK(t == 1800);
+    CHECK(slept == MCP9808::convMs[MCP9808::RES_0_25C]);
+    CHECK(regs._regs[8] == MCP9808::RES_0_25C);
+    CHECK(regs._regs[1] & 0x100);
+
+    // start/finish leave the device converting in between
+    CHECK(sensor.start(MCP9808::RES_0_125C) == MCP9808::convMs[MCP9808::RES_0_125C]);
+    CHECK((regs._regs[1] & 0x100) == 0);
+    CHECK(sensor.finish() == 1800);
+    CHECK(regs._regs[1] & 0x100);
+
+    // background read: not ready until the emulated bus latency has passed
+    regs.latency = 3;
+    regs.temp = 2500;
+    sensor.startRead();
+    int polls = 1;
+    while (!sensor.readReady()) polls++;
+    CHECK(polls == 3);
+    CHECK(sensor.readResult() == 2500);
+    sensor.startRead();
+    CHECK(!sensor.readReady());
+    CHECK(sensor.readResult() == 2500); // waits for completion
+    regs.fail = true; // no ACK, the result must not look like a temperature
+    sensor.startRead();
+    while (!sensor.readReady()) ;
+    CHECK(sensor.readResult() == MCP9808::NO_TEMP);
+    regs.fail = false;
+    sensor.startRead();
+    CHECK(sensor.readResult() == 2500);
+
+    // limits are rounded to 0.25C and show up as window flags in the temperature register
+    sensor.setLimits(2480, 2520, 8500);
+    CHECK(regs.limit(3) == 396); // 24.75C in 1/16C
+    CHECK(regs.limit(2) == 404); // 25.25C
+    CHECK(regs.limit(4) == 1360); // 85C
+    regs.temp = 2500;
+    CHECK((regs.tempReg() & 0xE000) == 0);
+    regs.temp = 2600;
+    CHECK((regs.tempReg() & 0xE000) == 1<<14); // above upper
+    regs.temp = 2400;
+    CHECK((regs.tempReg() & 0xE000) == 1<<13); // below lower
+    regs.temp = 9000;
+    CHECK((regs.tempReg() & 0xE000) == (1<<15 | 1<<14)); // crit and above upper
+    sensor.setLimits(-1000, -500, 8500);
+    CHECK(regs.limit(3) == -160);
+    CHECK(regs.limit(2) == -80);
+    regs.temp = -800;
+    CHECK((regs.tempReg() & 0xE000) == 0);
+    CHECK(sensor.read() == -800);
+
+    // setAlert keeps the shutdown bit and configures the output, disableAlert turns it off
+    sensor.sleep();
+    sensor.setAlert(true, true, 2);
+    CHECK(regs._regs[1] == (0x100 | 2<<9 | 1<<3 | 1<<1 | 1<<0));
+    sensor.clearAlert(); // the clear bit is not stored
+    CHECK(regs._regs[1] == (0x100 | 2<<9 | 1<<3 | 1<<1 | 1<<0));
+    sensor.disableAlert();
+    CHECK(regs._regs[1] == 0x100);
+
+    printf("%s\n", fails ? "FAILED" : "ok");
+    return fails ? 1 : 0;
+}
@@ -9,29 +9,222 @@
 
 #include "MCP9808.h"
 
+constexpr uint16_t MCP9808::convMs[4];
+
 bool MCP9808::init () {
     //for (int i=1; i<8; i++)
     //    printf("reg %d = 0x%x\r\n", i, readReg(i));
     if (_regs.read(6) != 0x54 || _regs.read(7) != 0x400) return false;
-    _regs.write(1, 0x100); // set shutdown mode
-    _regs.write(8, 2);     // set resolution 2=0.125C, 3=0.0625C
+    _config = 0x100;
+    _regs.write(1, _config); // set shutdown mode
+    _regs.write(8, _res);  // set resolution 2=0.125C, 3=0.0625C
     return true;
 }
 
 // convert puts the device into continuous conversion mode and return the number of
 // milliseconds before the first conversion completes.
 uint32_t MCP9808::convert() {
-    _regs.write(1, 0); // set continuous conversion mode
-    return 130;
+    _config &= ~0x100;
+    _regs.write(1, _config); // set continuous conversion mode
+    return convMs[_res];
+}
+
+// centi converts the ambient temperature register to 1/100th centigrade
+static int32_t centi(int32_t v) {
+    v = (v<<19)>>19; // sign-extend
+    return (v*100 + (v >= 0 ? 8 : -8)) / 16; // round to nearest
 }
 
 // read returns the current temperature in 1/100th centigrade, assume a conversion is ready
 int32_t MCP9808::read() {
-    int32_t v = _regs.read(5);
-    v = (v<<19)>>19; // sign-extend
-    return (v*100 + 8) / 16;
+    return centi(_regs.read(5));
+}
+
+int32_t MCP9808::readResult() {
+    while (!_regs.ready()) ;
+    if (_regs.failed()) return NO_TEMP;
+    return centi(_regs.result());
 }
 
 void MCP9808::sleep() {
-    _regs.write(1, 0x100);
+    _config |= 0x100;
+    _regs.write(1, _config);
+}
+
+// limit converts 1/100th centigrade to the limit register format: 0.25C resolution in b12..b2
+static uint16_t limit(int32_t t) {
+    int32_t v = (t >= 0 ? t + 12 : t - 12) / 25; // round to 0.25C
+    return (v << 2) & 0x1FFC;
+}
+
+void MCP9808::setLimits(int32_t lower, int32_t upper, int32_t crit) {
+    _regs.write(3, limit(lower));
+    _regs.write(2, limit(upper));
+    _regs.write(4, limit(crit));
+}
+
+void MCP9808::setAlert(bool interrupt, bool activeHigh, uint8_t hyst) {
+    _config &= 0x100; // keep shutdown bit
+    _config |= (hyst & 3) << 9;
+    _config |= 1<<3; // alert output enabled, for upper, lower and crit
+    if (activeHigh) _config |= 1<<1;
+    if (interrupt) _config |= 1<<0;
+    _regs.write(1, _config);
+}
+
+void MCP9808::disableAlert() {
+    _config &= 0x100;
+    _regs.write(1, _config);
+}
+
+void MCP9808::clearAlert() {
+    _regs.write(1, _config | (1<<5));
+}
+
+bool MCP9808::alert() {
+    return (_regs.read(1) & (1<<4)) != 0;
+}
+
+void MCP9808::resolution(uint8_t res) {
+    if (res > RES_0_0625C || res == _res) return;
+    _res = res;
+    _regs.write(8, _res);
+}
+
+uint32_t MCP9808::start(uint8_t res) {
+    resolution(res);
+    return convert();
+}
+
+int32_t MCP9808::finish() {
+    int32_t t = read();
+    sleep();
+    return t;
+}
+
+int32_t MCP9808::oneShot(void (*delayMs)(uint32_t), uint8_t res) {
+    delayMs(start(res));
+    return finish();
+}
+
+#if JEEH
+
+static constexpr uint32_t RCC_IOPENR  = 0x4002102C;
+static constexpr uint32_t RCC_APB1ENR = 0x40021038;
+static constexpr uint32_t GPIOB       = 0x50000400;
+static constexpr uint32_t I2C1        = 0x40005400;
+static constexpr uint32_t I2C_CR1 = I2C1+0x00, I2C_CR2 = I2C1+0x04, I2C_TIMINGR = I2C1+0x10,
+        I2C_ISR = I2C1+0x18, I2C_ICR = I2C1+0x1C, I2C_RXDR = I2C1+0x24, I2C_TXDR = I2C1+0x28;
+static constexpr uint32_t NVIC_ISER   = 0xE000E100;
+static constexpr int I2C1_IRQn        = 23;
+
+// ISR and CR2 bits
+static constexpr uint32_t TXIS = 1<<1, RXNE = 1<<2, NACKF = 1<<4, STOPF = 1<<5, TC = 1<<6;
+static constexpr uint32_t BERR = 1<<8, ARLO = 1<<9, OVR = 1<<10, ERRS = BERR | ARLO | OVR;
+static constexpr uint32_t RD_WRN = 1<<10, START = 1<<13, AUTOEND = 1<<25;
+// CR1 interrupt enables: TXIE, RXIE, NACKIE, STOPIE, TCIE, ERRIE
+static constexpr uint32_t IRQS = (1<<1) | (1<<2) | (1<<4) | (1<<5) | (1<<6) | (1<<7);
+
+void MCP9808I2cL0::init (uint32_t timing) {
+    MMIO32(RCC_IOPENR) |= 1<<1; // GPIOB
+    MMIO32(RCC_APB1ENR) |= 1<<21; // I2C1EN
+    // PB6 and PB7: alternate function 1, open drain, pull-up
+    MMIO32(GPIOB+0x00) = (MMIO32(GPIOB+0x00) & ~(0xF<<12)) | (0xA<<12);
+    MMIO32(GPIOB+0x04) |= 3<<6;
+    MMIO32(GPIOB+0x0C) = (MMIO32(GPIOB+0x0C) & ~(0xF<<12)) | (0x5<<12);
+    MMIO32(GPIOB+0x20) = (MMIO32(GPIOB+0x20) & ~(0xFF<<24)) | (0x11<<24);
+
+    MMIO32(I2C_CR1) = 0;
+    MMIO32(I2C_TIMINGR) = timing;
+    MMIO32(I2C_CR1) = 1; // PE
+    MMIO32(NVIC_ISER) = 1<<I2C1_IRQn;
+}
+
+// busReset clears the error flags and resets the peripheral after a bus error, lost arbitration or
+// overrun, which leave the transaction in an unknown state
+static void busReset () {
+    MMIO32(I2C_ICR) = ERRS;
+    MMIO32(I2C_CR1) &= ~(IRQS | 1); // PE off resets the state machine and disables the interrupts
+    while (MMIO32(I2C_CR1) & 1) ;
+    MMIO32(I2C_CR1) |= 1;
 }
+
+// wait polls for one of the ISR bits, returns false if the device did not ACK or the bus failed
+static bool wait (uint32_t bits) {
+    uint32_t isr;
+    while (((isr = MMIO32(I2C_ISR)) & (bits | NACKF | ERRS)) == 0) ;
+    if (isr & ERRS) {
+        busReset();
+        return false;
+    }
+    if ((isr & NACKF) == 0) return true;
+    while ((MMIO32(I2C_ISR) & STOPF) == 0) ; // NACK generates a STOP
+    MMIO32(I2C_ICR) = NACKF | STOPF;
+    return false;
+}
+
+uint16_t MCP9808I2cL0::read (uint8_t r) const {
+    MMIO32(I2C_CR2) = (_addr<<1) | (1<<16) | START;
+    if (!wait(TXIS)) return 0;
+    MMIO32(I2C_TXDR) = r;
+    if (!wait(TC)) return 0;
+    MMIO32(I2C_CR2) = (_addr<<1) | RD_WRN | (2<<16) | AUTOEND | START; // repeated start
+    if (!wait(RXNE)) return 0;
+    uint16_t v = MMIO32(I2C_RXDR) << 8;
+    wait(RXNE);
+    v |= MMIO32(I2C_RXDR);
+    wait(STOPF);
+    MMIO32(I2C_ICR) = STOPF;
+    return v;
+}
+
+void MCP9808I2cL0::write (uint8_t r, uint16_t v) const {
+    uint8_t buf[3] = { r, (uint8_t)(v>>8), (uint8_t)v };
+    if (r == 8) buf[1] = v; // resolution register is 8 bits
+    int n = r == 8 ? 2 : 3;
+    MMIO32(I2C_CR2) = (_addr<<1) | (n<<16) | AUTOEND | START;
+    for (int i=0; i<n; i++) {
+        if (!wait(TXIS)) return;
+        MMIO32(I2C_TXDR) = buf[i];
+    }
+    wait(STOPF);
+    MMIO32(I2C_ICR) = STOPF;
+}
+
+// startRead performs the same sequence as read but driven by the interrupt handler.
+void MCP9808I2cL0::startRead (uint8_t r) {
+    _reg = r;
+    _nRx = 0;
+    _result = 0;
+    _state = ADDR;
+    MMIO32(I2C_CR1) |= IRQS;
+    MMIO32(I2C_CR2) = (_addr<<1) | (1<<16) | START;
+}
+
+void MCP9808I2cL0::irq () {
+    uint32_t isr = MMIO32(I2C_ISR);
+    if (isr & ERRS) {
+        busReset(); // no STOP follows, so the interrupts get disabled here
+        _state = FAILED;
+        return;
+    }
+    if (isr & NACKF) {
+        MMIO32(I2C_ICR) = NACKF;
+        _state = FAILED; // the STOP that follows disables the interrupts
+    } else if (isr & TXIS) {
+        MMIO32(I2C_TXDR) = _reg;
+    } else if (isr & TC) {
+        _state = DATA;
+        MMIO32(I2C_CR2) = (_addr<<1) | RD_WRN | (2<<16) | AUTOEND | START;
+    } else if (isr & RXNE) {
+        _result = (_result << 8) | MMIO32(I2C_RXDR);
+        _nRx++;
+    }
+    if (isr & STOPF) {
+        MMIO32(I2C_ICR) = STOPF;
+        MMIO32(I2C_CR1) &= ~IRQS;
+        if (_state != FAILED) _state = IDLE;
+    }
+}
+
+#endif
@@ -2,9 +2,22 @@
 #ifndef _MCP9808_
 #define _MCP9808_
 
+#include <stdint.h>
+
 struct MCP9808Regs {
     virtual uint16_t read (uint8_t r) const = 0; // read 16-bit register r
     virtual void write (uint8_t r, uint16_t v) const = 0; // write 16-bit register r
+
+    // startRead begins reading register r in the background and ready() returns true once the
+    // value can be fetched using result(), or failed() returns true if the read did not complete.
+    // Backends that cannot read asynchronously perform a blocking read, which is what the defaults
+    // do.
+    virtual void startRead (uint8_t r) { _result = read(r); }
+    virtual bool ready () const { return true; }
+    virtual uint16_t result () const { return _result; }
+    virtual bool failed () const { return false; }
+
+    volatile uint16_t _result; // written by the interrupt handler in asynchronous backends
 };
 
 #if JEEH
@@ -33,21 +46,49 @@ struct MCP9808Jeeh : MCP9808Regs {
     }
 };
 
+// MCP9808I2cL0 uses the STM32L0's I2C1 peripheral on PB6 (SCL) and PB7 (SDA) instead of
+// bit-banging. Blocking accesses poll the peripheral, startRead runs the transaction from the I2C1
+// interrupt so the uC can sleep or talk to the radio meanwhile. The application must forward the
+// interrupt: extern "C" void I2C1_IRQHandler() { regs.irq(); }
+struct MCP9808I2cL0 : MCP9808Regs {
+    MCP9808I2cL0(uint8_t addr =0x18) : _addr(addr), _state(IDLE) {};
+
+    // init configures the pins and I2C1, the default timing is RM0367's value for 400kHz with a
+    // 16MHz PCLK; other clocks need their own TIMINGR value, see RM0367 "I2C timings".
+    void init (uint32_t timing =0x10320309);
+
+    uint16_t read (uint8_t r) const;
+    void write (uint8_t r, uint16_t v) const;
+
+    void startRead (uint8_t r);
+    bool ready () const { return _state == IDLE || _state == FAILED; }
+    bool failed () const { return _state == FAILED; } // no ACK from the device, or a bus error
+
+    void irq (); // I2C1 interrupt handler
+
+    //private:
+    enum { IDLE, ADDR, DATA, FAILED };
+    uint8_t _addr;
+    uint8_t _reg;
+    volatile uint8_t _state;
+    volatile uint8_t _nRx;
+};
+
 #elif ARDUINO
 
 struct MCP9808Arduino : MCP9808Regs {
-    MCP9808Regs(TwoWire &i2c, uint8_t addr = 0x18) : _i2c(i2c), _addr(addr) {};
+    MCP9808Arduino(TwoWire &i2c, uint8_t addr = 0x18) : _i2c(i2c), _addr(addr) {};
 
     // read a 16-bit register
-    uint16_t read (uint8_t r) {
-        uint8_t c = _i2c.requestFrom(_addr, 2, r, 1, true);
+    uint16_t read (uint8_t r) const {
+        uint8_t c = _i2c.requestFrom(_addr, (uint8_t)2, (uint32_t)r, (uint8_t)1, (uint8_t)true);
         if (c != 2) return 0; // may not be the best error value...
         int v = _i2c.read();
         return uint16_t((v<<8) | _i2c.read());
     }
 
     // write a 16-bit register
-    void write (uint8_t r, uint16_t v) {
+    void write (uint8_t r, uint16_t v) const {
         _i2c.beginTransmission(_addr);
         _i2c.write(r);
         if (r != 8) _i2c.write(v>>8);
@@ -60,16 +101,116 @@ struct MCP9808Arduino : MCP9808Regs {
     uint8_t _addr;
 };
 
+#else
+
+// MCP9808Fake emulates the device's registers on the host to exercise the driver and the
+// applications without hardware. The temperature register reflects `temp`, the resolution and
+// the limits. A background read completes after `latency` calls to ready(), which emulates an
+// interrupt-driven bus, setting `fail` makes it end like a transaction the device did not ACK.
+// The extras/faketest.cpp host program exercises the driver with it.
+struct MCP9808Fake : MCP9808Regs {
+    MCP9808Fake() : temp(2000), latency(3), fail(false), nRead(0), nWrite(0), _pending(0) {
+        for (int i=0; i<9; i++) _regs[i] = 0;
+        _regs[6] = 0x54;
+        _regs[7] = 0x400;
+        _regs[8] = 3;
+    }
+
+    uint16_t read (uint8_t r) const {
+        nRead++;
+        if (r == 5) return tempReg();
+        return r < 9 ? _regs[r] : 0;
+    }
+
+    void write (uint8_t r, uint16_t v) const {
+        nWrite++;
+        if (r == 1) v &= ~(1<<5); // interrupt clear bit is not stored
+        if (r == 8) v &= 3;
+        if (r >= 1 && r <= 4) _regs[r] = v;
+        if (r == 8) _regs[r] = v;
+    }
+
+    void startRead (uint8_t r) { _result = read(r); _pending = latency; }
+    bool ready () const { if (_pending > 0) _pending--; return _pending == 0; }
+    bool failed () const { return fail && _pending == 0; }
+
+    // tempReg formats `temp` like the device: 1/16C in b12..b0 truncated to the resolution,
+    // plus the crit/upper/lower flags in b15..b13
+    uint16_t tempReg () const {
+        int32_t v = temp * 16;
+        v = (v >= 0 ? v : v - 99) / 100; // round towards -inf
+        v &= ~((1 << (3 - _regs[8])) - 1);
+        uint16_t f = 0;
+        if (v >= limit(4)) f |= 1<<15;
+        if (v > limit(2)) f |= 1<<14;
+        if (v < limit(3)) f |= 1<<13;
+        return f | (v & 0x1FFF);
+    }
+
+    // limit returns limit register r in 1/16C
+    int32_t limit (uint8_t r) const {
+        int16_t v = _regs[r] << 3;
+        return v >> 3;
+    }
+
+    int32_t temp; // temperature in 1/100C
+    int latency; // ready() calls before a background read completes
+    bool fail; // background reads fail
+    mutable int nRead, nWrite; // number of register accesses
+
+    //private:
+    mutable uint16_t _regs[9];
+    mutable int _pending;
+};
+
 #endif
 
 struct MCP9808 {
-    MCP9808(MCP9808Regs &regs) : _regs(regs) { };
+    MCP9808(MCP9808Regs &regs) : _regs(regs), _config(0x100), _res(RES_0_125C) { };
     bool init(); // set resolution and shutdown, return true if device responded
     uint32_t convert(); // continuous mode, returns ms before first conversion
     int32_t read(); // temp in 1/100th centigrade
     void sleep(); // set sleep mode
+
+    // Resolutions, the conversion time roughly doubles with each step, see convMs.
+    enum { RES_0_5C, RES_0_25C, RES_0_125C, RES_0_0625C, RES_KEEP = 0xFF };
+    // convMs holds the conversion time in ms for each resolution (datasheet tCONV).
+    static constexpr uint16_t convMs[4] = { 30, 65, 130, 250 };
+
+    void resolution(uint8_t res); // set resolution, only writes the device if it changes
+
+    // The MCP9808 has no one-shot mode, instead it is woken up for a single conversion and shut
+    // down again right after reading it, which avoids the ~200uA drawn while converting.
+    // start optionally changes the resolution, wakes the device and returns the number of ms
+    // before the conversion completes; finish reads the temperature and shuts the device down.
+    // oneShot does both, using the provided delay function, e.g. wait_ms or delay.
+    uint32_t start(uint8_t res =RES_KEEP);
+    int32_t finish();
+    int32_t oneShot(void (*delayMs)(uint32_t), uint8_t res =RES_KEEP);
+
+    // startRead fetches the temperature in the background if the backend supports it,
+    // readReady returns true when done and readResult returns the temperature, waiting if needed,
+    // or NO_TEMP if the bus transaction failed.
+    void startRead() { _regs.startRead(5); }
+    bool readReady() { return _regs.ready(); }
+    int32_t readResult();
+    static constexpr int32_t NO_TEMP = INT32_MIN;
+
+    // The ALERT output signals when the temperature leaves the window between the lower and upper
+    // limits or exceeds the critical limit. It only works while converting continuously, which
+    // draws ~200uA, so it pays off when it saves many uC wake-ups.
+    void setLimits(int32_t lower, int32_t upper, int32_t crit); // limits in 1/100th centigrade
+    // setAlert enables the ALERT output in comparator mode (asserted while outside the window),
+    // or in interrupt mode (asserted until clearAlert()), with hysteresis 0..3 = 0/1.5/3/6C.
+    void setAlert(bool interrupt =false, bool activeHigh =false, uint8_t hyst =0);
+    void disableAlert();
+    void clearAlert(); // de-assert ALERT in interrupt mode
+    bool alert(); // true if ALERT is asserted
+
     //private:
     MCP9808Regs &_regs;
+    uint16_t _config; // config register shadow
+    uint8_t _res; // current resolution
 };
 
 #endif
@@ -0,0 +1,51 @@
+// This example monitors the battery voltage using the analog watchdog: TIM2 triggers a conversion
+// ten times a second and the CPU sleeps until the watchdog signals that the voltage dropped below
+// a cutoff. No CPU wake-up happens for the individual conversions.
+#include <Arduino.h>
+#include <stm32l0xx_ll_bus.h>
+#include <stm32l0xx_ll_tim.h>
+#include <stm32l0xx_ll_adc.h>
+#include <STM32ADC.h>
+
+#define pinBAT  PB1     // battery voltage, 1:2 divider
+#define cutoff  3300    // battery cutoff in mV
+
+STM32ADC myADC(ADC1);
+volatile bool low;
+
+void batteryLow() {
+    myADC.stop(); // one notification is enough
+    low = true;
+}
+
+void setup() {
+    Serial.begin(115200);
+    pinMode(pinBAT, INPUT_ANALOG);
+    myADC.begin(pinBAT);
+
+    // raw threshold for the cutoff at the current Vcc
+    uint32_t vcc = myADC.measureVcc();
+    uint32_t lowLimit = (uint32_t)cutoff / 2 * 4095 / vcc;
+    Serial.print("Low limit: ");
+    Serial.println(lowLimit);
+
+    // TIM2 update at 10Hz triggers the conversions
+    LL_APB1_GRP1_EnableClock(LL_APB1_GRP1_PERIPH_TIM2);
+    LL_TIM_SetPrescaler(TIM2, SystemCoreClock / 10000 - 1);
+    LL_TIM_SetAutoReload(TIM2, 1000 - 1);
+    LL_TIM_SetTriggerOutput(TIM2, LL_TIM_TRGO_UPDATE);
+    LL_TIM_EnableCounter(TIM2);
+
+    myADC.setTrigger(LL_ADC_REG_TRIG_EXT_TIM2_TRGO);
+    myADC.setAnalogWatchdog(-1, 4095, lowLimit);
+    myADC.attachAnalogWatchdogInterrupt(batteryLow);
+    myADC.startConversion();
+}
+
+void loop() {
+    __WFI(); // Sleep mode until an interrupt, the ADC keeps converting
+    if (low) {
+        Serial.println("Battery low!");
+        low = false;
+    }
+}
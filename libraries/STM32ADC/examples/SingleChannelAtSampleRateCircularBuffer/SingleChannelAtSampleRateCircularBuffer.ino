@@ -1,87 +1,73 @@
-#include <HardwareTimer.h>
+// This example samples one pin at a fixed rate using TIM2 to trigger the conversions and DMA to
+// transfer the results into a circular buffer. Each time half the buffer is full the callback
+// gets invoked and the loop processes that half while the DMA fills the other half. The CPU is
+// not involved in the individual conversions at all.
+#include <Arduino.h>
+#include <stm32l0xx_ll_bus.h>
+#include <stm32l0xx_ll_tim.h>
+#include <stm32l0xx_ll_adc.h>
 #include <STM32ADC.h>
 
-#define pinLED  PC13
-#define pinOUT  PB0
+#define pinLED  LED_BUILTIN
+#define pinIN   PB1
 
-#define _SEND_BY_USB
-#ifdef SEND_BY_USB
-USBSerial usb;
-#endif
+#define maxSamples      2000
+#define sampleFreqKhz   200
 
-// Channels to be acquired. 
-// A0 (adc1 channel 1)
-uint8 pins = 0;
-
-#define maxSamples  2000
 uint16_t buffer[maxSamples];
-uint16_t *buffers[2];
-uint8_t bufr;
-uint8_t bufw;
-
-#define sampleFreqKhz       200
-#define samplePeriodus      1000 / sampleFreqKhz
-#define ticksPerSecond      2 * sampleFreqKhz * 1000 / maxSamples
-
+volatile uint16_t *filled;      // half of the buffer ready to be processed, if any
+volatile uint32_t halves;       // number of halves filled
+volatile uint32_t overruns;     // halves not processed in time
 
 STM32ADC myADC(ADC1);
 
-
-long ticks;
-void TimerIRQ(void) {
-  ticks++;
+// bufferFull is called from the DMA interrupt each time half the buffer is filled.
+void bufferFull(uint16_t *samples, uint16_t count) {
+    if (filled) overruns++;
+    filled = samples;
+    halves++;
 }
-void DmaIRQ(void) {
-  digitalWrite(pinOUT, ! digitalRead(pinOUT));
-  bufw = (bufw+1)%2;
-  ticks++;
+
+// startTimer has TIM2 generate a TRGO update event at the requested rate.
+void startTimer(uint32_t hz) {
+    LL_APB1_GRP1_EnableClock(LL_APB1_GRP1_PERIPH_TIM2);
+    LL_TIM_SetPrescaler(TIM2, 0);
+    LL_TIM_SetAutoReload(TIM2, SystemCoreClock / hz - 1);
+    LL_TIM_SetTriggerOutput(TIM2, LL_TIM_TRGO_UPDATE);
+    LL_TIM_EnableCounter(TIM2);
 }
 
 void setup() {
-  
-  pinMode(pinLED, OUTPUT);
-  pinMode(pinOUT, OUTPUT);
-  pinMode(pins, INPUT_ANALOG);
-
-  Serial.begin(115200);
-  Serial.println("START");  
-
-  #ifdef SEND_BY_USB
-  usb.begin();
-  while (!usb.isConnected()) ;
-  #endif
-
-  ticks = 0;
-  bufr = 0;
-  bufw = 0;
-  buffers[0] = &buffer[0];
-  buffers[1] = &buffer[maxSamples/2];
-
-  Timer3.setPeriod(samplePeriodus);
-  Timer3.setMasterModeTrGo(TIMER_CR2_MMS_UPDATE);
-
-  myADC.calibrate();
-  myADC.setSampleRate(ADC_SMPR_1_5); // ?
-  myADC.setPins(&pins, 1);
-  myADC.setDMA(buffer, maxSamples, (DMA_MINC_MODE | DMA_CIRC_MODE | DMA_HALF_TRNS | DMA_TRNS_CMPLT), DmaIRQ);
-  myADC.setTrigger(ADC_EXT_EV_TIM3_TRGO);
-  myADC.startConversion();
+    pinMode(pinLED, OUTPUT);
+    pinMode(pinIN, INPUT_ANALOG);
+
+    Serial.begin(115200);
+    Serial.println("START");
+
+    myADC.begin(pinIN);
+    LL_ADC_SetLowPowerMode(ADC1, LL_ADC_LP_MODE_NONE); // no auto-off at this rate
+    myADC.setSampleRate(LL_ADC_SAMPLINGTIME_1CYCLE_5);
+    myADC.setDMA(buffer, maxSamples, bufferFull);
+    myADC.setTrigger(LL_ADC_REG_TRIG_EXT_TIM2_TRGO);
+    myADC.startConversion(); // arms the ADC, the timer triggers each conversion
+    startTimer(sampleFreqKhz * 1000);
 }
 
 void loop() {
-
-  if (bufr!=bufw) {
-    // process data 
-    
-    #ifdef SEND_BY_USB
-    if (usb.isConnected()) usb.write((uint8_t *)buffers[bufr],maxSamples); // send it : (maxSamples /2 )*2 (bytes)
-    #endif
-
-    bufr = (bufr+1)%2;
-  }
-  
-  if (ticks==ticksPerSecond) {
-    digitalWrite(pinLED, ! digitalRead(pinLED));
-    ticks = 0;
-  }
+    if (filled) {
+        // process data
+        uint16_t *samples = (uint16_t *)filled;
+        uint32_t sum = 0;
+        for (int i=0; i<maxSamples/2; i++) sum += samples[i];
+        filled = 0;
+
+        // each half is 5ms at 200kHz, print about once a second
+        if (halves % (2 * sampleFreqKhz * 1000 / maxSamples) == 0) {
+            Serial.print("avg: ");
+            Serial.print(sum / (maxSamples/2));
+            Serial.print(" overruns: ");
+            Serial.println(overruns);
+            digitalWrite(pinLED, !digitalRead(pinLED));
+        }
+    }
 }
@@ -1,50 +1,45 @@
+// This example converts one pin at a time using the end-of-conversion interrupt: the CPU sleeps
+// while the ADC calibrates and converts, and the callback delivers the result. irqCount shows how
+// often the ADC woke up the CPU.
+#include <Arduino.h>
 #include <STM32ADC.h>
 
-STM32ADC myADC(ADC1); 
+#define pinIN   PB1
 
-uint8 pin = D7; 
+STM32ADC myADC(ADC1);
 
-#define BOARD_LED D33 //this is for Maple Mini
-volatile static bool triggered = 0; 
-uint32 dado_adc = 0; 
-
-
-void int_func() {
-  
-  triggered = 1; 
-  dado_adc = myADC.getData();
-  }
+volatile bool done;
+volatile uint32_t result;
 
+void calibrated() {
+    done = true;
+}
 
+void converted(uint32_t value) {
+    result = value;
+    done = true;
+}
 
 void setup() {
-  Serial.begin(19200); 
-  pinMode(BOARD_LED, OUTPUT);
-  pinMode(D32, INPUT);
-  pinMode(D11, INPUT_ANALOG);//AD pin.
-//startup blink... good idea from Pig-O-Scope
-  digitalWrite(BOARD_LED, HIGH);
-  delay(1000);
-  digitalWrite(BOARD_LED, LOW);
-  delay(1000);
-  myADC.calibrate();
-  myADC.setSampleRate(ADC_SMPR_1_5);
-  myADC.attachInterrupt(int_func, ADC_EOC);
-  myADC.setPins(&pin, 1);  
-  
+    Serial.begin(115200);
+    pinMode(pinIN, INPUT_ANALOG);
+    myADC.begin(pinIN);
+
+    // recalibrate in the background
+    done = false;
+    myADC.startCalibration(calibrated);
+    while (!done) __WFI();
+    Serial.println("calibrated");
 }
 
-
-
 void loop() {
-      if(digitalRead(D32) == 1 ) {
-      Serial.println("begin");      
-      // Take our samples
-      myADC.startConversion(); 
-      while (triggered == 0); //wait here... 
-      
-      Serial.print("Readin: ");
-      Serial.println(dado_adc);      
-      }
-
+    done = false;
+    myADC.startConversion(converted);
+    while (!done) __WFI(); // Sleep mode until the conversion completes
+
+    Serial.print("Reading: ");
+    Serial.print(result);
+    Serial.print(" irqs: ");
+    Serial.println(myADC.irqCount);
+    delay(1000);
 }
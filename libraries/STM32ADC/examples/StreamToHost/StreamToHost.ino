@@ -0,0 +1,80 @@
+// This example streams one pin sampled at 150kHz to a host over USART1 at 4Mbaud. TIM2 triggers
+// the conversions, DMA fills a circular buffer, and each half of the buffer is sent by DMA
+// straight out of the buffer using ADCStream, so the CPU only handles a few interrupts per
+// half-buffer and sleeps otherwise. The CPU load is measured by timing the sleep, with interrupts
+// masked so the handlers count as busy, and sent along in the stream. Receive the stream on Linux
+// using extras/adcrecv.cpp, e.g., `./adcrecv /dev/ttyACM1 4000000 capture.bin`.
+#include <Arduino.h>
+#include <stm32l0xx_ll_bus.h>
+#include <stm32l0xx_ll_tim.h>
+#include <stm32l0xx_ll_adc.h>
+#include <STM32ADC.h>
+#include <ADCStream.h>
+
+#define pinIN   PB1
+
+#define maxSamples      2000
+#define sampleFreqKhz   150
+#define baudRate        4000000
+
+uint16_t buffer[maxSamples];
+
+STM32ADC myADC(ADC1);
+ADCStream stream;
+
+// bufferFull is called from the DMA interrupt each time half the buffer is filled.
+void bufferFull(uint16_t *samples, uint16_t count) {
+    stream.send(samples, count);
+}
+
+// startTimer has TIM2 generate a TRGO update event at the requested rate.
+void startTimer(uint32_t hz) {
+    LL_APB1_GRP1_EnableClock(LL_APB1_GRP1_PERIPH_TIM2);
+    LL_TIM_SetPrescaler(TIM2, 0);
+    LL_TIM_SetAutoReload(TIM2, SystemCoreClock / hz - 1);
+    LL_TIM_SetTriggerOutput(TIM2, LL_TIM_TRGO_UPDATE);
+    LL_TIM_EnableCounter(TIM2);
+}
+
+void setup() {
+    pinMode(pinIN, INPUT_ANALOG);
+    stream.begin(baudRate);
+
+    myADC.begin(pinIN);
+    LL_ADC_SetLowPowerMode(ADC1, LL_ADC_LP_MODE_NONE); // no auto-off at this rate
+    myADC.setSampleRate(LL_ADC_SAMPLINGTIME_1CYCLE_5);
+    myADC.setDMA(buffer, maxSamples, bufferFull);
+    myADC.setTrigger(LL_ADC_REG_TRIG_EXT_TIM2_TRGO);
+    myADC.startConversion();
+    startTimer(sampleFreqKhz * 1000);
+}
+
+uint32_t idleUs, startUs;
+
+// microsMasked is micros() for use with interrupts masked: a SysTick that came due has not
+// incremented the millisecond count yet, so it is added here.
+uint32_t microsMasked() {
+    uint32_t pending, us;
+    do {
+        pending = SCB->ICSR & SCB_ICSR_PENDSTSET_Msk;
+        us = micros();
+    } while (pending != (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk));
+    return pending ? us + 1000 : us;
+}
+
+void loop() {
+    // sleep until the next interrupt and account for the time asleep, WFI wakes up on a pending
+    // interrupt even while they are masked, and the handler only runs once they are enabled again
+    __disable_irq();
+    uint32_t t0 = microsMasked();
+    __WFI();
+    idleUs += microsMasked() - t0;
+    __enable_irq();
+
+    uint32_t elapsed = micros() - startUs;
+    if (elapsed >= 1000000) {
+        stream.load = 1000 - (uint64_t)idleUs * 1000 / elapsed;
+        idleUs = 0;
+        startUs = micros();
+    }
+}
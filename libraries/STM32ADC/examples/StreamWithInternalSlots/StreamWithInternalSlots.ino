@@ -0,0 +1,74 @@
+// This example streams one pin at 1kHz using TIM2 and circular DMA, like
+// SingleChannelAtSampleRateCircularBuffer, and adds Vrefint and the temperature sensor as two
+// extra slots to each scan, such that Vcc and the uC temperature are monitored without stopping
+// the stream. Each scan thus produces three values: pin, Vrefint, temperature.
+#include <Arduino.h>
+#include <stm32l0xx_ll_bus.h>
+#include <stm32l0xx_ll_tim.h>
+#include <stm32l0xx_ll_adc.h>
+#include <STM32ADC.h>
+
+#define pinLED  LED_BUILTIN
+#define pinIN   PB1
+
+#define scanLen         3
+#define maxSamples      (scanLen * 200) // must be a multiple of 2*scanLen
+#define scanFreqHz      1000
+
+uint16_t buffer[maxSamples];
+volatile uint16_t *filled;      // half of the buffer ready to be processed, if any
+volatile uint32_t halves;       // number of halves filled
+
+STM32ADC myADC(ADC1);
+
+// bufferFull is called from the DMA interrupt each time half the buffer is filled.
+void bufferFull(uint16_t *samples, uint16_t count) {
+    filled = samples;
+    halves++;
+}
+
+// startTimer has TIM2 generate a TRGO update event at the requested rate.
+void startTimer(uint32_t hz) {
+    LL_APB1_GRP1_EnableClock(LL_APB1_GRP1_PERIPH_TIM2);
+    LL_TIM_SetPrescaler(TIM2, 0);
+    LL_TIM_SetAutoReload(TIM2, SystemCoreClock / hz - 1);
+    LL_TIM_SetTriggerOutput(TIM2, LL_TIM_TRGO_UPDATE);
+    LL_TIM_EnableCounter(TIM2);
+}
+
+void setup() {
+    pinMode(pinLED, OUTPUT);
+    pinMode(pinIN, INPUT_ANALOG);
+
+    Serial.begin(115200);
+    Serial.println("START");
+
+    myADC.begin(pinIN);
+    myADC.setSampleRate(LL_ADC_SAMPLINGTIME_160CYCLES_5); // long enough for the internal slots
+    myADC.injectInternal();
+    myADC.setDMA(buffer, maxSamples, bufferFull);
+    myADC.setTrigger(LL_ADC_REG_TRIG_EXT_TIM2_TRGO); // each trigger converts a full scan
+    myADC.startConversion();
+    startTimer(scanFreqHz);
+}
+
+void loop() {
+    if (filled) {
+        uint16_t *samples = (uint16_t *)filled;
+        uint32_t sum = 0;
+        for (int i=0; i<maxSamples/2; i+=scanLen) sum += samples[i];
+        STM32ADC::Measurement m = myADC.internal(samples); // internal slots of the first scan
+        filled = 0;
+
+        // each half is 100ms, print about once a second
+        if (halves % 10 == 0) {
+            Serial.print("avg: ");
+            Serial.print(sum / (maxSamples/2/scanLen) * m.vcc / 4095);
+            Serial.print("mV vcc: ");
+            Serial.print(m.vcc);
+            Serial.print("mV temp: ");
+            Serial.println(m.temp);
+            digitalWrite(pinLED, !digitalRead(pinLED));
+        }
+    }
+}
@@ -0,0 +1,157 @@
+// adcrecv receives a sample stream sent by ADCStream over a serial port, checks that the frames
+// are contiguous and writes the samples to a capture file as raw little-endian 16-bit values.
+// It prints the sample rate, gaps and the device-side counters once a second.
+//
+// Build and run on Linux from this directory:
+//   g++ -O2 adcrecv.cpp -o adcrecv && ./adcrecv /dev/ttyACM1 4000000 capture.bin
+//
+// A gap in the sequence numbers means halves were dropped on the device, and the half before the
+// gap was partly overwritten while it was sent. The samples around a gap are still written, so
+// the capture is only contiguous if the summary reports no gaps. Garbage between frames, e.g.,
+// after connecting mid-stream, is skipped by resyncing on the magic number.
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <time.h>
+
+// Header mirrors ADCStream::Header, all fields are little-endian.
+struct Header {
+    uint16_t magic;
+    uint16_t count;
+    uint32_t seq;
+    uint16_t dropped;
+    uint16_t load;
+    uint32_t reserved;
+};
+
+static const uint16_t magic = 0x5AA5;
+static const uint16_t maxCount = 8192;
+
+static speed_t baudConst(uint32_t baud) {
+    switch (baud) {
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+    case 1000000: return B1000000;
+    case 2000000: return B2000000;
+    case 3000000: return B3000000;
+    case 4000000: return B4000000;
+    default: return 0;
+    }
+}
+
+// readFull reads exactly len bytes, it returns false on EOF or error.
+static bool readFull(int fd, void *buf, size_t len) {
+    uint8_t *p = (uint8_t *)buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+// sync reads until the magic number and the rest of a plausible header have been received, prev
+// is the last byte already read.
+static bool sync(int fd, Header &h, uint8_t prev) {
+    uint8_t b[2] = { 0, prev };
+    for (;;) {
+        b[0] = b[1];
+        if (!readFull(fd, b+1, 1)) return false;
+        if ((b[0] | b[1] << 8) != magic) continue;
+        h.magic = magic;
+        if (!readFull(fd, (uint8_t *)&h + 2, sizeof(h) - 2)) return false;
+        if (h.count > 0 && h.count <= maxCount) return true;
+    }
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 4) {
+        fprintf(stderr, "usage: %s <tty> <baud> <capture-file>\n", argv[0]);
+        return 2;
+    }
+    speed_t speed = baudConst(strtoul(argv[2], 0, 10));
+    if (speed == 0) {
+        fprintf(stderr, "unsupported baud rate %s\n", argv[2]);
+        return 2;
+    }
+    int fd = open(argv[1], O_RDONLY | O_NOCTTY);
+    if (fd < 0) { perror(argv[1]); return 1; }
+    struct termios tio;
+    tcgetattr(fd, &tio);
+    cfmakeraw(&tio);
+    cfsetspeed(&tio, speed);
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    tcsetattr(fd, TCSANOW, &tio);
+    tcflush(fd, TCIFLUSH);
+
+    FILE *out = fopen(argv[3], "wb");
+    if (!out) { perror(argv[3]); return 1; }
+
+    static uint16_t samples[maxCount];
+    Header h;
+    bool synced = false, first = true;
+    uint32_t nextSeq = 0;
+    uint64_t total = 0, frames = 0, gaps = 0, missing = 0, resyncs = 0;
+    uint64_t lastTotal = 0;
+    double t0 = now(), tLast = t0;
+
+    for (;;) {
+        // the next header must follow immediately, else the stream is corrupt and needs a resync
+        if (synced && !readFull(fd, &h, 2)) break;
+        if (!synced || h.magic != magic) {
+            if (synced) resyncs++;
+            if (!sync(fd, h, synced ? h.magic >> 8 : 0)) break;
+            synced = true;
+        } else {
+            if (!readFull(fd, (uint8_t *)&h + 2, sizeof(h) - 2)) break;
+            if (h.count == 0 || h.count > maxCount) {
+                resyncs++;
+                synced = false;
+                continue;
+            }
+        }
+        if (!readFull(fd, samples, h.count * 2)) break;
+        if (!first && h.seq != nextSeq) {
+            gaps++;
+            missing += h.seq - nextSeq;
+            fprintf(stderr, "gap: expected seq %u got %u\n", nextSeq, h.seq);
+        }
+        first = false;
+        nextSeq = h.seq + 1;
+        fwrite(samples, 2, h.count, out);
+        total += h.count;
+        frames++;
+
+        double t = now();
+        if (t - tLast >= 1.0) {
+            printf("%.1f kS/s, %llu frames, %llu gaps (%llu halves), %llu resyncs, "
+                    "device: %u dropped, load %.1f%%\n",
+                    (total - lastTotal) / (t - tLast) / 1000, (unsigned long long)frames,
+                    (unsigned long long)gaps, (unsigned long long)missing,
+                    (unsigned long long)resyncs, h.dropped, h.load / 10.0);
+            fflush(stdout);
+            lastTotal = total;
+            tLast = t;
+        }
+    }
+
+    fclose(out);
+    printf("%llu samples in %.1fs, %llu frames, %llu gaps (%llu halves missing)\n",
+            (unsigned long long)total, now() - t0, (unsigned long long)frames,
+            (unsigned long long)gaps, (unsigned long long)missing);
+    return gaps ? 1 : 0;
+}
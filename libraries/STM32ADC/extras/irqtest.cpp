@@ -0,0 +1,210 @@
+// Host test for the interrupt-driven parts of STM32ADC, run against the register-level model of
+// the STM32L0 ADC in mock/. It checks that startConversion delivers one interrupt per conversion
+// and turns the interrupt off at the end of a single scan, that continuous mode keeps it on
+// until stopped, that startCalibration completes from the interrupt, and that irqCount counts
+// every wake-up including the analog watchdog. It also checks that begin restores a cached
+// calibration without converting anything, that checkCalibration only recalibrates on drift,
+// that begin<pin>() sets the pin to analog mode, and that a measurement in between a DMA stream
+// only stops it at the end of a scan.
+//
+// Build and run on Linux from this directory:
+//   g++ -O2 -Imock -I../src irqtest.cpp ../src/STM32ADC.cpp -o irqtest && ./irqtest
+#include <stdio.h>
+#include <Arduino.h>
+#include <stm32l0xx_ll_adc.h>
+#include <stm32l0xx_ll_rcc.h>
+#include "STM32ADC.h"
+
+static int fails;
+
+#define CHECK(cond) do { if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+    fails++; } } while (0)
+
+static uint32_t results[8];
+static int nResults;
+static void gotResult (uint32_t v) { if (nResults < 8) results[nResults] = v; nResults++; }
+
+static int nCalDone, nAwd;
+static void calDone () { nCalDone++; }
+static void awdFired () { nAwd++; }
+
+int main() {
+    for (int c=0; c<10; c++) mockValue[c] = 100 * (c+1);
+    mockValue[17] = mockVrefintCal; // Vcc = 3V
+    mockValue[18] = mockTsCal1;     // 30C
+
+    STM32ADC adc(ADC1);
+
+    // begin calibrates by polling, without any interrupt, and puts the pin into analog mode
+    GPIOB->PUPDR = 1u<<2;
+    CHECK(adc.begin<PB_1>());
+    CHECK((GPIOB->MODER >> 2 & 3) == 3 && GPIOB->PUPDR == 0);
+    CHECK(RCC->IOPENR == RCC_IOPENR_GPIOBEN);
+    CHECK(mockCalibrations == 1);
+    CHECK(adc.calibration.valid && adc.calibration.factor == mockCalFactor);
+    CHECK(ADC1->CALFACT == mockCalFactor);
+    CHECK(ADC1->CR & ADC_CR_ADEN);
+    CHECK(ADC1->CHSELR == 1u<<9);
+    CHECK(adc.irqCount == 0);
+    CHECK(!mockNvicAdc);
+    CHECK(mockConversions == 0 && mockDelayUs == 0);
+
+    // single conversion: one interrupt, after which EOCIE is off again
+    mockConversions = 0;
+    adc.startConversion(gotResult);
+    CHECK(mockNvicAdc);
+    CHECK(ADC1->IER & ADC_ISR_EOC);
+    CHECK(nResults == 0);
+    CHECK(mockStep());
+    CHECK(nResults == 1 && results[0] == mockValue[9]);
+    CHECK(adc.irqCount == 1);
+    CHECK(!(ADC1->IER & ADC_ISR_EOC));
+    CHECK(!(ADC1->CR & ADC_CR_ADSTART));
+    CHECK(!mockStep()); // nothing pending
+    CHECK(adc.irqCount == 1);
+    CHECK(mockConversions == 1);
+
+    // scan of three channels: an interrupt per channel, in channel order
+    nResults = 0;
+    adc.setChannels(1<<0 | 1<<3 | 1<<9);
+    adc.startConversion(gotResult);
+    while (mockStep()) ;
+    CHECK(nResults == 3);
+    CHECK(results[0] == mockValue[0] && results[1] == mockValue[3] && results[2] == mockValue[9]);
+    CHECK(adc.irqCount == 4);
+    CHECK(!(ADC1->IER & ADC_ISR_EOC));
+    CHECK(!(ADC1->ISR & (ADC_ISR_EOC | ADC_ISR_EOS)));
+
+    // continuous mode keeps the interrupt on until stopped
+    nResults = 0;
+    adc.setChannels(1<<9);
+    adc.setContinuous();
+    adc.startConversion(gotResult);
+    for (int i=0; i<5; i++) CHECK(mockStep());
+    CHECK(nResults == 5);
+    CHECK(adc.irqCount == 9);
+    CHECK(ADC1->IER & ADC_ISR_EOC);
+    adc.stop();
+    CHECK(!(ADC1->CR & ADC_CR_ADSTART));
+    CHECK(!mockStep());
+    CHECK(adc.irqCount == 9);
+    adc.setContinuous(false);
+    ADC1->IER = 0;
+
+    // compile-time channels follow the STM32L0 assignment
+    static_assert(STM32ADCChannel<PA_0>::channel == 0, "PA_0");
+    static_assert(STM32ADCChannel<PA_7>::channel == 7, "PA_7");
+    static_assert(STM32ADCChannel<PB_0>::channel == 8, "PB_0");
+    static_assert(STM32ADCChannel<PC_0>::channel == 10, "PC_0");
+    static_assert(STM32ADCChannel<PC_5>::channel == 15, "PC_5");
+
+    // a measurement in between polls, saves and restores the configuration, and raises no irq
+    mockDelayUs = 0;
+    STM32ADC::Measurement m = adc.measure<PA_2>();
+    CHECK(m.vcc == 3000);
+    CHECK(m.temp == 30);
+    CHECK(m.mV == (uint32_t)mockValue[2] * 3000 / 4095);
+    CHECK(mockDelayUs == LL_ADC_DELAY_TEMPSENSOR_STAB_US);
+    CHECK(ADC1->CHSELR == 1u<<9);
+    CHECK(adc.irqCount == 9);
+
+    // measuring in the middle of a DMA scan lets the scan finish first, the restart begins with
+    // the first channel, so it must land in the first slot of a scan
+    uint16_t buf[6];
+    adc.setChannels(1<<0 | 1<<3 | 1<<9);
+    adc.setContinuous();
+    adc.setDMA(buf, 6, 0);
+    adc.startConversion();
+    CHECK(mockStep());
+    CHECK(DMA1->CNDTR == 5);
+    uint32_t convs = mockConversions;
+    m = adc.measure<PA_2>();
+    CHECK(m.mV == (uint32_t)mockValue[2] * 3000 / 4095);
+    CHECK(mockConversions == convs + 2 + 3); // rest of the scan, then the measurement
+    CHECK(DMA1->CNDTR == 3);
+    CHECK(ADC1->CR & ADC_CR_ADSTART);
+    CHECK(ADC1->CFGR1 & ADC_CFGR1_DMAEN);
+    for (int i=0; i<3; i++) CHECK(mockStep());
+    CHECK(DMA1->CNDTR == 6);
+    adc.stopDMA();
+    adc.setContinuous(false);
+    adc.setChannels(1<<9);
+    CHECK(adc.irqCount == 9);
+
+    // background calibration: the ADC is off until the end-of-calibration interrupt
+    mockCalFactor = 0x55;
+    uint32_t cals = mockCalibrations;
+    adc.startCalibration(calDone);
+    CHECK(adc.calibrating());
+    CHECK(!adc.calibration.valid);
+    CHECK(!(ADC1->CR & ADC_CR_ADEN));
+    CHECK(ADC1->CR & ADC_CR_ADCAL);
+    CHECK(adc.irqCount == 9);
+    CHECK(mockStep());
+    CHECK(!adc.calibrating());
+    CHECK(nCalDone == 1);
+    CHECK(adc.irqCount == 10);
+    CHECK(mockCalibrations == cals + 1);
+    CHECK(adc.calibration.valid && adc.calibration.factor == 0x55);
+    CHECK(ADC1->CR & ADC_CR_ADEN);
+    CHECK(!(ADC1->IER & ADC_ISR_EOCAL));
+
+    // the watchdog wakes the CPU only for results outside the window
+    adc.setAnalogWatchdog(9, 2000, 500);
+    adc.attachAnalogWatchdogInterrupt(awdFired);
+    adc.startConversion();
+    CHECK(mockStep());
+    CHECK(nAwd == 0 && adc.irqCount == 10);
+    mockValue[9] = 2500;
+    adc.startConversion();
+    CHECK(mockStep());
+    CHECK(nAwd == 1 && adc.irqCount == 11);
+    CHECK(!(ADC1->ISR & ADC_ISR_AWD));
+    adc.attachAnalogWatchdogInterrupt(0);
+    adc.clearAnalogWatchdog();
+    adc.startConversion();
+    CHECK(mockStep());
+    CHECK(nAwd == 1 && adc.irqCount == 11);
+
+    // a spurious interrupt is counted but dispatches nothing
+    nResults = 0;
+    adc.irq();
+    CHECK(adc.irqCount == 12);
+    CHECK(nResults == 0 && nCalDone == 1 && nAwd == 1);
+
+    // begin with a cached calibration for the same clock mode only writes the factor
+    STM32ADC adc2(ADC1);
+    adc2.calibration = adc.calibration;
+    mockConversions = mockDelayUs = 0;
+    cals = mockCalibrations;
+    CHECK(adc2.begin<PB_1>());
+    CHECK(mockCalibrations == cals);
+    CHECK(mockConversions == 0 && mockDelayUs == 0);
+    CHECK(ADC1->CALFACT == 0x55);
+    mockHsiReady = false; // other clock mode
+    CHECK(adc2.begin<PB_1>());
+    CHECK(mockCalibrations == cals + 1);
+    CHECK(adc2.calibration.clock == LL_ADC_CLOCK_SYNC_PCLK_DIV2);
+    CHECK(mockConversions == 0 && mockDelayUs == 0);
+
+    // checkCalibration records the conditions of the first measurement after a calibration and
+    // recalibrates once they drifted beyond the limits
+    m = adc2.measure<PB_1>();
+    CHECK(!adc2.checkCalibration(m));
+    CHECK(adc2.calibration.vcc == 3000 && adc2.calibration.temp == 30);
+    mockValue[17] = mockVrefintCal * 3000 / 2950; // Vcc down by ~50mV
+    m = adc2.measure<PB_1>();
+    CHECK(!adc2.checkCalibration(m));
+    CHECK(mockCalibrations == cals + 1);
+    CHECK(adc2.calibration.vcc == 3000);
+    mockValue[18] = mockTsCal1 + 40; // ~+15C
+    m = adc2.measure<PB_1>();
+    CHECK(adc2.checkCalibration(m));
+    CHECK(mockCalibrations == cals + 2);
+    CHECK(adc2.calibration.valid && adc2.calibration.temp == m.temp);
+    CHECK(ADC1->CR & ADC_CR_ADEN);
+    CHECK(!adc2.checkCalibration(adc2.measure<PB_1>()));
+
+    printf("%s\n", fails ? "FAILED" : "ok");
+    return fails ? 1 : 0;
+}
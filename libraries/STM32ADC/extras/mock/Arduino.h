@@ -0,0 +1,94 @@
+// Host-side stand-in for the parts of the Arduino core and the STM32L0 CMSIS definitions that
+// STM32ADC uses, see stm32l0xx_ll_adc.h in this directory for the ADC model.
+#ifndef _MOCK_ARDUINO_
+#define _MOCK_ARDUINO_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define STM32L0xx 1
+
+typedef void (*voidFuncPtr)(void);
+
+// ADC registers, only the ones STM32ADC uses, with the bit positions of the STM32L0
+struct ADC_TypeDef {
+    volatile uint32_t ISR, IER, CR, CFGR1, CFGR2, SMPR, TR, CHSELR, DR, CALFACT;
+};
+struct ADC_Common_TypeDef {
+    volatile uint32_t CCR;
+};
+struct DMA_TypeDef {
+    volatile uint32_t ISR, CCR, CNDTR;
+};
+
+#define ADC_ISR_ADRDY     (1u<<0)
+#define ADC_ISR_EOC       (1u<<2)
+#define ADC_ISR_EOS       (1u<<3)
+#define ADC_ISR_OVR       (1u<<4)
+#define ADC_ISR_AWD       (1u<<7)
+#define ADC_ISR_EOCAL     (1u<<11)
+#define ADC_CR_ADEN       (1u<<0)
+#define ADC_CR_ADDIS      (1u<<1)
+#define ADC_CR_ADSTART    (1u<<2)
+#define ADC_CR_ADSTP      (1u<<4)
+#define ADC_CR_ADCAL      (1u<<31)
+#define ADC_CFGR1_DMAEN   (1u<<0)
+#define ADC_CFGR1_DMACFG  (1u<<1)
+#define ADC_CFGR1_RES     (3u<<3)
+#define ADC_CFGR1_ALIGN   (1u<<5)
+#define ADC_CFGR1_EXTSEL  (7u<<6)
+#define ADC_CFGR1_EXTEN   (3u<<10)
+#define ADC_CFGR1_OVRMOD  (1u<<12)
+#define ADC_CFGR1_CONT    (1u<<13)
+#define ADC_CFGR1_WAIT    (1u<<14)
+#define ADC_CFGR1_AUTOFF  (1u<<15)
+#define ADC_CFGR1_DISCEN  (1u<<16)
+#define ADC_CFGR1_AWDSGL  (1u<<22)
+#define ADC_CFGR1_AWDEN   (1u<<23)
+#define ADC_CFGR1_AWDCH   (0x1Fu<<26)
+#define ADC_CFGR2_OVSE    (1u<<0)
+#define ADC_CFGR2_OVSR_Pos 2
+#define ADC_CFGR2_OVSR    (7u<<ADC_CFGR2_OVSR_Pos)
+#define ADC_CFGR2_OVSS_Pos 5
+#define ADC_CFGR2_OVSS    (0xFu<<ADC_CFGR2_OVSS_Pos)
+#define ADC_CFGR2_TOVS    (1u<<9)
+#define ADC_CFGR2_CKMODE  (3u<<30)
+#define ADC_SMPR_SMP      (7u<<0)
+#define ADC_CHSELR_CHSEL  (0x7FFFFu)
+#define ADC_CCR_VREFEN    (1u<<22)
+#define ADC_CCR_TSEN      (1u<<23)
+#define ADC_CCR_LFMEN     (1u<<25)
+
+#define MODIFY_REG(r, clear, set) ((r) = ((r) & ~(clear)) | (set))
+
+// factory calibration of Vrefint, the instances and functions are in stm32l0xx_ll_adc.h
+#define VREFINT_CAL_ADDR (&mockVrefintCal)
+#define VREFINT_CAL_VREF 3000u
+
+typedef enum { IRQn_None = -1, DMA1_Channel1_IRQn = 9, ADC1_COMP_IRQn = 12 } IRQn_Type;
+
+// pins of the STM32L0 ADC inputs, digital pin numbers are the PinName values
+typedef enum { PA_0 = 0x00, PA_1, PA_2, PA_3, PA_4, PA_5, PA_6, PA_7,
+    PB_0 = 0x10, PB_1, PC_0 = 0x20, PC_1, PC_2, PC_3, PC_4, PC_5, NC = 0xFF } PinName;
+
+// GPIO ports and their clock enables, for setting pins to analog mode
+struct GPIO_TypeDef {
+    volatile uint32_t MODER, PUPDR;
+};
+struct RCC_TypeDef {
+    volatile uint32_t IOPENR;
+};
+#define RCC_IOPENR_GPIOAEN (1u<<0)
+#define RCC_IOPENR_GPIOBEN (1u<<1)
+#define RCC_IOPENR_GPIOCEN (1u<<2)
+inline GPIO_TypeDef mockGpio[3];
+inline RCC_TypeDef mockRcc;
+#define GPIOA (&mockGpio[0])
+#define GPIOB (&mockGpio[1])
+#define GPIOC (&mockGpio[2])
+#define RCC (&mockRcc)
+#define INPUT_ANALOG 3
+#define STM_PIN_CHANNEL(fn) (fn)
+#define PinMap_ADC ((const void *)0)
+
+#endif
@@ -0,0 +1,276 @@
+// Host-side model of the STM32L0 ADC behind the LL functions STM32ADC uses, for the tests in
+// extras. The LL functions read and write the ADC_TypeDef registers with the real bit positions,
+// and a small state machine plays the hardware:
+//
+// - ADSTART set by StartConversion walks the channels selected in CHSELR in ascending order, each
+//   conversion puts mockValue[chan] into DR and sets EOC, the last one also sets EOS, and in
+//   single mode clears ADSTART. In wait mode a conversion is held until DR has been read.
+// - ADCAL set by StartCalibration completes by loading mockCalFactor into CALFACT and setting
+//   EOCAL.
+// - Enable, disable and stop take effect immediately.
+//
+// Time only passes when the code busy-waits, i.e. when it polls EOC or the calibration status,
+// which completes the next pending operation, or when the test calls mockStep(), which completes
+// one pending operation and then raises the ADC interrupt if an enabled flag is set. Counters
+// let the tests check how much work the code did. The DMA is only modelled as far as counting
+// down CNDTR for each result it takes from DR, polling CNDTR advances the conversions like EOC.
+#ifndef _MOCK_LL_ADC_
+#define _MOCK_LL_ADC_
+
+#include <Arduino.h>
+
+#define LL_ADC_RESOLUTION_12B           0u
+#define LL_ADC_DATA_ALIGN_RIGHT         0u
+#define LL_ADC_LP_MODE_NONE             0u
+#define LL_ADC_LP_AUTOWAIT              ADC_CFGR1_WAIT
+#define LL_ADC_LP_AUTOPOWEROFF          ADC_CFGR1_AUTOFF
+#define LL_ADC_LP_AUTOWAIT_AUTOPOWEROFF (ADC_CFGR1_WAIT | ADC_CFGR1_AUTOFF)
+#define LL_ADC_SAMPLINGTIME_1CYCLE_5    0u
+#define LL_ADC_REG_TRIG_SOFTWARE        0u
+#define LL_ADC_REG_TRIG_EXT_TIM2_TRGO   ((2u<<6) | (1u<<10))
+#define LL_ADC_REG_CONV_SINGLE          0u
+#define LL_ADC_REG_CONV_CONTINUOUS      ADC_CFGR1_CONT
+#define LL_ADC_REG_DMA_TRANSFER_NONE    0u
+#define LL_ADC_REG_DMA_TRANSFER_LIMITED ADC_CFGR1_DMAEN
+#define LL_ADC_REG_DMA_TRANSFER_UNLIMITED (ADC_CFGR1_DMAEN | ADC_CFGR1_DMACFG)
+#define LL_ADC_REG_OVR_DATA_OVERWRITTEN ADC_CFGR1_OVRMOD
+#define LL_ADC_REG_SEQ_DISCONT_DISABLE  0u
+#define LL_ADC_AWD_DISABLE              0u
+#define LL_ADC_CHANNEL_VREFINT          (1u<<17)
+#define LL_ADC_CHANNEL_TEMPSENSOR       (1u<<18)
+#define LL_ADC_PATH_INTERNAL_NONE       0u
+#define LL_ADC_PATH_INTERNAL_VREFINT    ADC_CCR_VREFEN
+#define LL_ADC_PATH_INTERNAL_TEMPSENSOR ADC_CCR_TSEN
+#define LL_ADC_DELAY_TEMPSENSOR_STAB_US 10u
+#define LL_ADC_CLOCK_SYNC_PCLK_DIV2     (1u<<30)
+#define LL_ADC_CLOCK_ASYNC_DIV2         (1u<<18) // ADC_CCR_PRESC_0, as in the real LL
+#define LL_ADC_CLOCK_FREQ_MODE_HIGH     0u
+#define LL_ADC_CLOCK_FREQ_MODE_LOW      ADC_CCR_LFMEN
+#define LL_ADC_DMA_REG_REGULAR_DATA     0u
+
+#define LL_ADC_OVS_RATIO_2   (0u<<ADC_CFGR2_OVSR_Pos)
+#define LL_ADC_OVS_RATIO_4   (1u<<ADC_CFGR2_OVSR_Pos)
+#define LL_ADC_OVS_RATIO_8   (2u<<ADC_CFGR2_OVSR_Pos)
+#define LL_ADC_OVS_RATIO_16  (3u<<ADC_CFGR2_OVSR_Pos)
+#define LL_ADC_OVS_RATIO_32  (4u<<ADC_CFGR2_OVSR_Pos)
+#define LL_ADC_OVS_RATIO_64  (5u<<ADC_CFGR2_OVSR_Pos)
+#define LL_ADC_OVS_RATIO_128 (6u<<ADC_CFGR2_OVSR_Pos)
+#define LL_ADC_OVS_RATIO_256 (7u<<ADC_CFGR2_OVSR_Pos)
+#define LL_ADC_OVS_SHIFT_NONE    (0u<<ADC_CFGR2_OVSS_Pos)
+#define LL_ADC_OVS_SHIFT_RIGHT_1 (1u<<ADC_CFGR2_OVSS_Pos)
+#define LL_ADC_OVS_SHIFT_RIGHT_2 (2u<<ADC_CFGR2_OVSS_Pos)
+#define LL_ADC_OVS_SHIFT_RIGHT_3 (3u<<ADC_CFGR2_OVSS_Pos)
+#define LL_ADC_OVS_SHIFT_RIGHT_4 (4u<<ADC_CFGR2_OVSS_Pos)
+#define LL_ADC_OVS_SHIFT_RIGHT_5 (5u<<ADC_CFGR2_OVSS_Pos)
+#define LL_ADC_OVS_SHIFT_RIGHT_6 (6u<<ADC_CFGR2_OVSS_Pos)
+#define LL_ADC_OVS_SHIFT_RIGHT_7 (7u<<ADC_CFGR2_OVSS_Pos)
+#define LL_ADC_OVS_SHIFT_RIGHT_8 (8u<<ADC_CFGR2_OVSS_Pos)
+
+#define __LL_ADC_COMMON_INSTANCE() (ADC1_COMMON)
+
+// temperature sensor factory calibration at 30C and 130C, at 3V like VREFINT_CAL
+inline uint16_t mockTsCal1 = 670, mockTsCal2 = 870;
+#define __LL_ADC_CALC_TEMPERATURE(vref, data, res) \
+    ((int32_t)((((int32_t)(data) * (int32_t)(vref) / 3000) - mockTsCal1) * 100 \
+            / (mockTsCal2 - mockTsCal1) + 30))
+
+inline ADC_TypeDef mockAdc;
+inline ADC_Common_TypeDef mockAdcCommon;
+inline DMA_TypeDef mockDma;
+inline ADC_TypeDef *ADC1 = &mockAdc;
+inline ADC_Common_TypeDef *ADC1_COMMON = &mockAdcCommon;
+inline DMA_TypeDef *DMA1 = &mockDma;
+
+inline uint16_t mockVrefintCal = 1650;  // Vrefint at 3V
+inline uint16_t mockValue[19];          // conversion result of each channel
+inline uint8_t mockCalFactor = 0x42;    // result of the next calibration
+inline bool mockNvicAdc;                // ADC interrupt enabled in the NVIC
+inline bool mockInIrq;                  // inside the interrupt handler, time stands still
+inline int mockChan = -1;               // channel converted next while ADSTART is set
+inline uint32_t mockConversions, mockCalibrations, mockDelayUs;
+inline uint32_t mockDmaLen;             // CNDTR reload value in circular mode
+
+// mockConvert completes the next conversion, it returns false if there is none or the wait mode
+// holds it.
+inline bool mockConvert() {
+    ADC_TypeDef *a = ADC1;
+    uint32_t chans = a->CHSELR & ADC_CHSELR_CHSEL;
+    if (!(a->CR & ADC_CR_ADSTART) || chans == 0) return false;
+    if ((a->CFGR1 & ADC_CFGR1_WAIT) && (a->ISR & ADC_ISR_EOC)) return false;
+    while (mockChan < 0 || !(chans & (1u<<mockChan))) mockChan = (mockChan + 1) % 19;
+    uint16_t v = mockValue[mockChan];
+    if (a->ISR & ADC_ISR_EOC) a->ISR |= ADC_ISR_OVR;
+    a->DR = v;
+    a->ISR |= ADC_ISR_EOC;
+    mockConversions++;
+    if ((a->CFGR1 & ADC_CFGR1_DMAEN) && (DMA1->CCR & 1)) { // the DMA reads DR, clearing EOC
+        a->ISR &= ~ADC_ISR_EOC;
+        if (--DMA1->CNDTR == 0) DMA1->CNDTR = mockDmaLen;
+    }
+    if ((a->CFGR1 & ADC_CFGR1_AWDEN) && (!(a->CFGR1 & ADC_CFGR1_AWDSGL)
+            || (int)((a->CFGR1 & ADC_CFGR1_AWDCH) >> 26) == mockChan)
+            && (v > (a->TR >> 16) || v < (a->TR & 0xFFFF)))
+        a->ISR |= ADC_ISR_AWD;
+    if ((chans >> (mockChan + 1)) == 0) { // end of the sequence
+        a->ISR |= ADC_ISR_EOS;
+        mockChan = -1;
+        if (!(a->CFGR1 & ADC_CFGR1_CONT)) a->CR &= ~ADC_CR_ADSTART;
+    } else {
+        mockChan++;
+    }
+    return true;
+}
+
+// mockCalibrate completes a pending calibration, if any.
+inline bool mockCalibrate() {
+    ADC_TypeDef *a = ADC1;
+    if (!(a->CR & ADC_CR_ADCAL)) return false;
+    a->CR &= ~ADC_CR_ADCAL;
+    a->CALFACT = mockCalFactor;
+    a->ISR |= ADC_ISR_EOCAL;
+    mockCalibrations++;
+    return true;
+}
+
+extern "C" void ADC1_COMP_IRQHandler(void);
+
+// mockStep completes one pending operation and raises the interrupt if an enabled flag is set.
+// It returns false if the ADC had nothing to do.
+inline bool mockStep() {
+    if (!mockCalibrate() && !mockConvert()) return false;
+    if (mockNvicAdc && (ADC1->ISR & ADC1->IER)) {
+        mockInIrq = true;
+        ADC1_COMP_IRQHandler();
+        mockInIrq = false;
+    }
+    return true;
+}
+
+inline void NVIC_SetPriority(IRQn_Type, uint32_t) {}
+inline void NVIC_EnableIRQ(IRQn_Type irq) { if (irq == ADC1_COMP_IRQn) mockNvicAdc = true; }
+inline void NVIC_DisableIRQ(IRQn_Type irq) { if (irq == ADC1_COMP_IRQn) mockNvicAdc = false; }
+inline void delayMicroseconds(uint32_t us) { mockDelayUs += us; }
+inline uint32_t HAL_RCC_GetPCLK2Freq(void) { return 2097152; }
+inline PinName digitalPinToPinName(uint32_t pin) { return (PinName)pin; }
+inline void *pinmap_find_peripheral(PinName pin, const void *) {
+    return pin <= PA_7 || pin == PB_0 || pin == PB_1 || (pin >= PC_0 && pin <= PC_5) ? ADC1 : 0;
+}
+inline uint32_t pinmap_find_function(PinName pin, const void *) {
+    return pin <= PA_7 ? pin : pin <= PB_1 ? pin - PB_0 + 8 : pin - PC_0 + 10;
+}
+
+// configuration
+
+inline void LL_ADC_SetResolution(ADC_TypeDef *a, uint32_t r) {
+    MODIFY_REG(a->CFGR1, ADC_CFGR1_RES, r);
+}
+inline void LL_ADC_SetDataAlignment(ADC_TypeDef *a, uint32_t v) {
+    MODIFY_REG(a->CFGR1, ADC_CFGR1_ALIGN, v);
+}
+inline void LL_ADC_SetLowPowerMode(ADC_TypeDef *a, uint32_t m) {
+    MODIFY_REG(a->CFGR1, ADC_CFGR1_WAIT | ADC_CFGR1_AUTOFF, m);
+}
+inline void LL_ADC_SetSamplingTimeCommonChannels(ADC_TypeDef *a, uint32_t t) {
+    MODIFY_REG(a->SMPR, ADC_SMPR_SMP, t);
+}
+inline void LL_ADC_REG_SetTriggerSource(ADC_TypeDef *a, uint32_t t) {
+    MODIFY_REG(a->CFGR1, ADC_CFGR1_EXTSEL | ADC_CFGR1_EXTEN, t);
+}
+inline void LL_ADC_REG_SetContinuousMode(ADC_TypeDef *a, uint32_t m) {
+    MODIFY_REG(a->CFGR1, ADC_CFGR1_CONT, m);
+}
+inline uint32_t LL_ADC_REG_GetContinuousMode(ADC_TypeDef *a) { return a->CFGR1 & ADC_CFGR1_CONT; }
+inline void LL_ADC_REG_SetDMATransfer(ADC_TypeDef *a, uint32_t m) {
+    MODIFY_REG(a->CFGR1, ADC_CFGR1_DMAEN | ADC_CFGR1_DMACFG, m);
+}
+inline uint32_t LL_ADC_REG_GetDMATransfer(ADC_TypeDef *a) {
+    return a->CFGR1 & (ADC_CFGR1_DMAEN | ADC_CFGR1_DMACFG);
+}
+inline void LL_ADC_REG_SetOverrun(ADC_TypeDef *a, uint32_t m) {
+    MODIFY_REG(a->CFGR1, ADC_CFGR1_OVRMOD, m);
+}
+inline void LL_ADC_REG_SetSequencerDiscont(ADC_TypeDef *a, uint32_t m) {
+    MODIFY_REG(a->CFGR1, ADC_CFGR1_DISCEN, m);
+}
+inline void LL_ADC_REG_SetSequencerChannels(ADC_TypeDef *a, uint32_t c) {
+    a->CHSELR = c & ADC_CHSELR_CHSEL;
+}
+inline uint32_t LL_ADC_REG_GetSequencerChannels(ADC_TypeDef *a) {
+    return a->CHSELR & ADC_CHSELR_CHSEL;
+}
+inline void LL_ADC_SetAnalogWDMonitChannels(ADC_TypeDef *a, uint32_t c) {
+    MODIFY_REG(a->CFGR1, ADC_CFGR1_AWDCH | ADC_CFGR1_AWDSGL | ADC_CFGR1_AWDEN, c);
+}
+inline void LL_ADC_ConfigAnalogWDThresholds(ADC_TypeDef *a, uint32_t high, uint32_t low) {
+    a->TR = high << 16 | low;
+}
+inline void LL_ADC_SetClock(ADC_TypeDef *a, uint32_t c) {
+    MODIFY_REG(a->CFGR2, ADC_CFGR2_CKMODE, c);
+}
+inline uint32_t LL_ADC_GetClock(ADC_TypeDef *a) { return a->CFGR2 & ADC_CFGR2_CKMODE; }
+inline void LL_ADC_SetCommonFrequencyMode(ADC_Common_TypeDef *c, uint32_t m) {
+    MODIFY_REG(c->CCR, ADC_CCR_LFMEN, m);
+}
+inline void LL_ADC_SetCommonPathInternalCh(ADC_Common_TypeDef *c, uint32_t p) {
+    MODIFY_REG(c->CCR, ADC_CCR_VREFEN | ADC_CCR_TSEN, p);
+}
+inline uint32_t LL_ADC_GetCommonPathInternalCh(ADC_Common_TypeDef *c) {
+    return c->CCR & (ADC_CCR_VREFEN | ADC_CCR_TSEN);
+}
+inline uint32_t LL_ADC_DMA_GetRegAddr(ADC_TypeDef *a, uint32_t) {
+    return (uint32_t)(uintptr_t)&a->DR;
+}
+
+// control
+
+inline void LL_ADC_Enable(ADC_TypeDef *a) { a->CR |= ADC_CR_ADEN; a->ISR |= ADC_ISR_ADRDY; }
+inline void LL_ADC_Disable(ADC_TypeDef *a) {
+    a->CR &= ~(ADC_CR_ADEN | ADC_CR_ADSTART);
+    a->ISR &= ~ADC_ISR_ADRDY;
+    mockChan = -1;
+}
+inline uint32_t LL_ADC_IsEnabled(ADC_TypeDef *a) { return (a->CR & ADC_CR_ADEN) != 0; }
+inline void LL_ADC_StartCalibration(ADC_TypeDef *a) { a->CR |= ADC_CR_ADCAL; }
+inline uint32_t LL_ADC_IsCalibrationOnGoing(ADC_TypeDef *a) {
+    if (!mockInIrq) mockCalibrate();
+    return (a->CR & ADC_CR_ADCAL) != 0;
+}
+inline uint32_t LL_ADC_GetCalibrationFactor(ADC_TypeDef *a) { return a->CALFACT & 0x7F; }
+inline void LL_ADC_SetCalibrationFactor(ADC_TypeDef *a, uint32_t f) { a->CALFACT = f & 0x7F; }
+inline void LL_ADC_REG_StartConversion(ADC_TypeDef *a) { a->CR |= ADC_CR_ADSTART; }
+inline void LL_ADC_REG_StopConversion(ADC_TypeDef *a) { a->CR &= ~ADC_CR_ADSTART; mockChan = -1; }
+inline uint32_t LL_ADC_REG_IsConversionOngoing(ADC_TypeDef *a) {
+    return (a->CR & ADC_CR_ADSTART) != 0;
+}
+inline uint32_t LL_ADC_REG_IsStopConversionOngoing(ADC_TypeDef *a) {
+    return (a->CR & ADC_CR_ADSTP) != 0;
+}
+inline uint32_t LL_ADC_REG_ReadConversionData32(ADC_TypeDef *a) {
+    a->ISR &= ~ADC_ISR_EOC;
+    return a->DR;
+}
+
+// flags and interrupts, EOC is where a busy-wait advances the conversions
+
+#define MOCK_ADC_FLAG(name, bit) \
+    inline uint32_t LL_ADC_IsActiveFlag_##name(ADC_TypeDef *a) { return (a->ISR & bit) != 0; } \
+    inline void LL_ADC_ClearFlag_##name(ADC_TypeDef *a) { a->ISR &= ~bit; } \
+    inline void LL_ADC_EnableIT_##name(ADC_TypeDef *a) { a->IER |= bit; } \
+    inline void LL_ADC_DisableIT_##name(ADC_TypeDef *a) { a->IER &= ~bit; } \
+    inline uint32_t LL_ADC_IsEnabledIT_##name(ADC_TypeDef *a) { return (a->IER & bit) != 0; }
+MOCK_ADC_FLAG(EOS, ADC_ISR_EOS)
+MOCK_ADC_FLAG(OVR, ADC_ISR_OVR)
+MOCK_ADC_FLAG(AWD, ADC_ISR_AWD)
+MOCK_ADC_FLAG(EOCAL, ADC_ISR_EOCAL)
+#undef MOCK_ADC_FLAG
+
+inline uint32_t LL_ADC_IsActiveFlag_EOC(ADC_TypeDef *a) {
+    if (!mockInIrq && !(a->ISR & ADC_ISR_EOC)) mockConvert();
+    return (a->ISR & ADC_ISR_EOC) != 0;
+}
+inline void LL_ADC_ClearFlag_EOC(ADC_TypeDef *a) { a->ISR &= ~ADC_ISR_EOC; }
+inline void LL_ADC_EnableIT_EOC(ADC_TypeDef *a) { a->IER |= ADC_ISR_EOC; }
+inline void LL_ADC_DisableIT_EOC(ADC_TypeDef *a) { a->IER &= ~ADC_ISR_EOC; }
+inline uint32_t LL_ADC_IsEnabledIT_EOC(ADC_TypeDef *a) { return (a->IER & ADC_ISR_EOC) != 0; }
+
+#endif
@@ -0,0 +1,25 @@
+// Host-side stand-in for the LL bus functions STM32ADC uses, a reset of ADC1 clears its
+// registers, see stm32l0xx_ll_adc.h.
+#ifndef _MOCK_LL_BUS_
+#define _MOCK_LL_BUS_
+
+#include "stm32l0xx_ll_adc.h"
+#include <string.h>
+
+#define LL_APB2_GRP1_PERIPH_ADC1 (1u<<9)
+#define LL_APB1_GRP2_PERIPH_ADC1 (1u<<9)
+#define LL_AHB1_GRP1_PERIPH_DMA1 (1u<<0)
+
+inline void LL_APB2_GRP1_EnableClock(uint32_t) {}
+inline void LL_APB2_GRP1_DisableClock(uint32_t) {}
+inline void LL_APB2_GRP1_ForceReset(uint32_t p) {
+    if (p & LL_APB2_GRP1_PERIPH_ADC1) {
+        memset((void *)ADC1, 0, sizeof(*ADC1));
+        ADC1_COMMON->CCR = 0;
+        mockChan = -1;
+    }
+}
+inline void LL_APB2_GRP1_ReleaseReset(uint32_t) {}
+inline void LL_AHB1_GRP1_EnableClock(uint32_t) {}
+
+#endif
@@ -0,0 +1,40 @@
+// Host-side stand-in for the LL DMA functions STM32ADC uses. The DMA is only modelled as far as
+// the transfer count goes, see mockConvert, the data does not reach the buffer, so readScan and
+// the contents of a stream cannot be tested with it.
+#ifndef _MOCK_LL_DMA_
+#define _MOCK_LL_DMA_
+
+#include "stm32l0xx_ll_adc.h"
+
+#define LL_DMA_CHANNEL_1                  1u
+#define LL_DMA_REQUEST_0                  0u
+#define LL_DMA_DIRECTION_PERIPH_TO_MEMORY 0u
+#define LL_DMA_MODE_NORMAL                0u
+#define LL_DMA_MODE_CIRCULAR              (1u<<5)
+#define LL_DMA_PERIPH_NOINCREMENT         0u
+#define LL_DMA_MEMORY_INCREMENT           (1u<<7)
+#define LL_DMA_PDATAALIGN_HALFWORD        (1u<<8)
+#define LL_DMA_MDATAALIGN_HALFWORD        (1u<<10)
+#define LL_DMA_PRIORITY_HIGH              (2u<<12)
+
+inline void LL_DMA_EnableChannel(DMA_TypeDef *d, uint32_t) { d->CCR |= 1; }
+inline void LL_DMA_DisableChannel(DMA_TypeDef *d, uint32_t) { d->CCR &= ~1u; }
+inline void LL_DMA_SetPeriphRequest(DMA_TypeDef *, uint32_t, uint32_t) {}
+inline void LL_DMA_ConfigTransfer(DMA_TypeDef *, uint32_t, uint32_t) {}
+inline void LL_DMA_ConfigAddresses(DMA_TypeDef *, uint32_t, uint32_t, uint32_t, uint32_t) {}
+inline void LL_DMA_SetDataLength(DMA_TypeDef *d, uint32_t, uint32_t n) {
+    d->CNDTR = mockDmaLen = n;
+}
+inline uint32_t LL_DMA_GetDataLength(DMA_TypeDef *d, uint32_t) {
+    if (!mockInIrq) mockConvert(); // busy-waiting on the DMA position lets time pass
+    return d->CNDTR;
+}
+inline void LL_DMA_EnableIT_HT(DMA_TypeDef *, uint32_t) {}
+inline void LL_DMA_EnableIT_TC(DMA_TypeDef *, uint32_t) {}
+inline void LL_DMA_ClearFlag_GI1(DMA_TypeDef *d) { d->ISR &= ~0xFu; }
+inline void LL_DMA_ClearFlag_HT1(DMA_TypeDef *d) { d->ISR &= ~4u; }
+inline void LL_DMA_ClearFlag_TC1(DMA_TypeDef *d) { d->ISR &= ~2u; }
+inline uint32_t LL_DMA_IsActiveFlag_HT1(DMA_TypeDef *d) { return (d->ISR & 4) != 0; }
+inline uint32_t LL_DMA_IsActiveFlag_TC1(DMA_TypeDef *d) { return (d->ISR & 2) != 0; }
+
+#endif
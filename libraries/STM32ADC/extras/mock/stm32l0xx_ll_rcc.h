@@ -0,0 +1,11 @@
+// Host-side stand-in for the LL RCC functions STM32ADC uses.
+#ifndef _MOCK_LL_RCC_
+#define _MOCK_LL_RCC_
+
+#include <stdint.h>
+
+inline bool mockHsiReady = true; // HSI16 running, which selects the asynchronous ADC clock
+
+inline uint32_t LL_RCC_HSI_IsReady(void) { return mockHsiReady; }
+
+#endif
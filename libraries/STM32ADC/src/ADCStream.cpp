@@ -0,0 +1,93 @@
+#include <Arduino.h>
+#include <stm32l0xx_ll_bus.h>
+#include <stm32l0xx_ll_rcc.h>
+#include <stm32l0xx_ll_gpio.h>
+#include <stm32l0xx_ll_usart.h>
+#include <stm32l0xx_ll_dma.h>
+#include "ADCStream.h"
+
+static ADCStream *txStream; // stream using DMA channel 2, for the interrupt handler
+
+// begin configures USART1 TX on PA9 and DMA1 channel 2 for transmission.
+void ADCStream::begin(uint32_t baud) {
+    txStream = this;
+
+    LL_IOP_GRP1_EnableClock(LL_IOP_GRP1_PERIPH_GPIOA);
+    LL_GPIO_SetPinMode(GPIOA, LL_GPIO_PIN_9, LL_GPIO_MODE_ALTERNATE);
+    LL_GPIO_SetAFPin_8_15(GPIOA, LL_GPIO_PIN_9, LL_GPIO_AF_4); // USART1_TX
+    LL_GPIO_SetPinSpeed(GPIOA, LL_GPIO_PIN_9, LL_GPIO_SPEED_FREQ_VERY_HIGH);
+    LL_GPIO_SetPinOutputType(GPIOA, LL_GPIO_PIN_9, LL_GPIO_OUTPUT_PUSHPULL);
+
+    LL_APB2_GRP1_EnableClock(LL_APB2_GRP1_PERIPH_USART1);
+    LL_USART_Disable(USART1);
+    uint32_t over = baud > 2000000 ? LL_USART_OVERSAMPLING_8 : LL_USART_OVERSAMPLING_16;
+    LL_USART_SetOverSampling(USART1, over);
+    LL_USART_SetBaudRate(USART1, LL_RCC_GetUSARTClockFreq(LL_RCC_USART1_CLKSOURCE), over, baud);
+    LL_USART_ConfigCharacter(USART1, LL_USART_DATAWIDTH_8B, LL_USART_PARITY_NONE,
+            LL_USART_STOPBITS_1);
+    LL_USART_SetTransferDirection(USART1, LL_USART_DIRECTION_TX);
+    LL_USART_DisableIT_TXE(USART1);
+    LL_USART_DisableIT_TC(USART1);
+    LL_USART_EnableDMAReq_TX(USART1);
+    LL_USART_Enable(USART1);
+
+    LL_AHB1_GRP1_EnableClock(LL_AHB1_GRP1_PERIPH_DMA1);
+    LL_DMA_DisableChannel(DMA1, LL_DMA_CHANNEL_2);
+    LL_DMA_SetPeriphRequest(DMA1, LL_DMA_CHANNEL_2, LL_DMA_REQUEST_3); // USART1_TX
+    LL_DMA_ConfigTransfer(DMA1, LL_DMA_CHANNEL_2,
+            LL_DMA_DIRECTION_MEMORY_TO_PERIPH | LL_DMA_MODE_NORMAL |
+            LL_DMA_PERIPH_NOINCREMENT | LL_DMA_MEMORY_INCREMENT |
+            LL_DMA_PDATAALIGN_BYTE | LL_DMA_MDATAALIGN_BYTE | LL_DMA_PRIORITY_MEDIUM);
+    LL_DMA_SetPeriphAddress(DMA1, LL_DMA_CHANNEL_2,
+            LL_USART_DMA_GetRegAddr(USART1, LL_USART_DMA_REG_DATA_TRANSMIT));
+    LL_DMA_ClearFlag_GI2(DMA1);
+    LL_DMA_EnableIT_TC(DMA1, LL_DMA_CHANNEL_2);
+    NVIC_SetPriority(DMA1_Channel2_3_IRQn, 1);
+    NVIC_EnableIRQ(DMA1_Channel2_3_IRQn);
+}
+
+// startTx starts a DMA transfer of len bytes to the UART.
+void ADCStream::startTx(const void *buf, uint16_t len) {
+    LL_DMA_DisableChannel(DMA1, LL_DMA_CHANNEL_2);
+    LL_DMA_SetMemoryAddress(DMA1, LL_DMA_CHANNEL_2, (uint32_t)buf);
+    LL_DMA_SetDataLength(DMA1, LL_DMA_CHANNEL_2, len);
+    LL_DMA_EnableChannel(DMA1, LL_DMA_CHANNEL_2);
+}
+
+// send starts sending the header for a half-buffer, txIRQ continues with the samples.
+void ADCStream::send(uint16_t *samples, uint16_t count) {
+    uint32_t seq = _seq++;
+    if (_busy) {
+        // the previous half is still in flight and the ADC is now overwriting it
+        dropped++;
+        return;
+    }
+    _hdr.magic = magic;
+    _hdr.count = count;
+    _hdr.seq = seq;
+    _hdr.dropped = dropped;
+    _hdr.load = load;
+    _hdr.reserved = 0;
+    _payload = samples;
+    _len = count;
+    _busy = true;
+    startTx(&_hdr, sizeof(_hdr));
+}
+
+// txIRQ chains the payload after the header and marks the stream idle at the end.
+void ADCStream::txIRQ() {
+    LL_DMA_ClearFlag_TC2(DMA1);
+    if (_payload) {
+        const uint16_t *p = _payload;
+        _payload = 0;
+        startTx(p, _len * 2);
+    } else {
+        _busy = false;
+        sent++;
+    }
+}
+
+extern "C" void DMA1_Channel2_3_IRQHandler(void) {
+    if (txStream && LL_DMA_IsActiveFlag_TC2(DMA1)) txStream->txIRQ();
+    else LL_DMA_ClearFlag_GI2(DMA1);
+}
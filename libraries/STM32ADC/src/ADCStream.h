@@ -0,0 +1,64 @@
+// ADCStream sends the samples of an STM32ADC circular DMA buffer to a host over a UART without
+// copying them: each half-buffer handed to the BufferCallback is transmitted by DMA straight out
+// of the ADC buffer, preceded by a small header with a sequence number and counters. The CPU is
+// only involved twice per half-buffer, to start the header and then the payload transfer.
+//
+// The UART must transmit a half-buffer before the ADC wraps around and overwrites it, i.e.,
+// within one half-buffer period. If the previous half is still being sent when the next one
+// completes the new half is dropped (dropped counts those), and as the ADC continues into the
+// half in flight, that one gets partly overwritten. The sequence number advances for every half,
+// so the receiver sees drops as gaps, and the half before a gap is suspect. At 4Mbaud the UART
+// moves 400kB/s, i.e., at most ~198kS/s of 16-bit samples with 1000-sample halves, so 150kS/s
+// leaves a comfortable margin.
+//
+// The implementation uses USART1 TX on PA9 with DMA1 channel 2 on the STM32L0, the USART is
+// configured from scratch so Serial may not be used at the same time. The extras/adcrecv.cpp
+// Linux program receives the stream, checks its continuity and writes a capture file.
+#ifndef _ADCSTREAM_
+#define _ADCSTREAM_
+
+#include <stdint.h>
+
+class ADCStream {
+public:
+    static constexpr uint16_t magic = 0x5AA5;
+
+    // Header precedes each half-buffer on the wire, all fields are little-endian.
+    struct Header {
+        uint16_t magic;   // ADCStream::magic
+        uint16_t count;   // number of 16-bit samples that follow
+        uint32_t seq;     // half-buffer sequence number, increments for dropped halves too
+        uint16_t dropped; // halves dropped so far (wraps)
+        uint16_t load;    // CPU load in 1/1000th as set by the application, see load
+        uint32_t reserved;
+    };
+
+    ADCStream() : sent(0), dropped(0), load(0), _seq(0), _payload(0), _len(0),
+        _busy(false) {};
+
+    // begin configures USART1 for transmission at the given baud rate, using 8x oversampling
+    // above 2Mbaud, and the DMA channel.
+    void begin(uint32_t baud);
+
+    // send starts sending a half-buffer, it is intended to be called from the BufferCallback.
+    void send(uint16_t *samples, uint16_t count);
+
+    // txIRQ handles the DMA transfer complete interrupt, it is called by the interrupt handler and
+    // does not need to be called by the application.
+    void txIRQ();
+
+    volatile uint32_t sent;    // halves sent
+    volatile uint32_t dropped; // halves dropped because the UART was still busy
+    uint16_t load;             // CPU load in 1/1000th, sent in the header for the host to show
+
+private:
+    void startTx(const void *buf, uint16_t len);
+
+    Header _hdr;
+    uint32_t _seq;
+    const uint16_t *_payload; // payload still to send after the header, if any
+    uint16_t _len;
+    volatile bool _busy;
+};
+
+#endif
@@ -2,18 +2,31 @@
 #include <stm32l0xx_ll_bus.h>
 #include <stm32l0xx_ll_rcc.h>
 #include <stm32l0xx_ll_adc.h>
+#include <stm32l0xx_ll_dma.h>
 #include "STM32ADC.h"
 
+static STM32ADC *dmaADC; // ADC using DMA channel 1, for the interrupt handler
+static STM32ADC *irqADC; // ADC using the ADC interrupt, for the interrupt handler
+
+// vrefToVcc calculates Vcc in millivolts from a Vrefint conversion scaled to 16 bits, like
+// __LL_ADC_CALC_VREFANALOG_VOLTAGE does for 12 bits.
+static uint32_t vrefToVcc(uint32_t raw16) {
+    if (raw16 == 0) return 0;
+    return (VREFINT_CAL_VREF * (uint32_t)(*VREFINT_CAL_ADDR) * 16 + raw16/2) / raw16;
+}
+
 // begin initializes the ADC device. It enables the clock, sets default conversion
-// parameters, runs a calibration cycle (waiting for it to complete) and sets the mux to the
-// specified pin. It leaves the ADC enabled in auto-off mode (if available). It returns true if
-// the pin can be converted by this ADC, the ADC is enabled regardless of the return value.
+// parameters, runs a calibration cycle (waiting for it to complete), or restores the cached
+// calibration, and sets the mux to the specified pin. It leaves the ADC enabled in auto-off mode
+// (if available). It returns true if the pin can be converted by this ADC.
 bool STM32ADC::begin(uint8_t pin) {
-    PinName pn = digitalPinToPinName(pin);
-    ADC_TypeDef *adc = (ADC_TypeDef *)pinmap_find_peripheral(pn, PinMap_ADC);
-    if (adc == NULL || adc != _adc) return false;
-    int chan = STM_PIN_CHANNEL(pinmap_find_function(pn, PinMap_ADC));
+    int chan = pinChannel(pin);
+    if (chan < 0) return false;
+    return beginChannel(chan);
+}
 
+// beginChannel initializes the ADC device to convert a channel, see begin.
+bool STM32ADC::beginChannel(int chan) {
     // Not sure how to handle differences between STM32 series...
     //LL_APB1_GRP2_EnableClock(LL_APB1_GRP2_PERIPH_ADC1); // STM32F1?
 #ifdef STM32L0xx
@@ -21,16 +34,7 @@ bool STM32ADC::begin(uint8_t pin) {
     LL_APB2_GRP1_ForceReset(LL_APB2_GRP1_PERIPH_ADC1);
     LL_APB2_GRP1_ReleaseReset(LL_APB2_GRP1_PERIPH_ADC1);
 
-    if (LL_RCC_HSI_IsReady()) {
-        // HSI16 running, use async clock
-        LL_ADC_SetClock(_adc, LL_ADC_CLOCK_ASYNC_DIV2); // Use div2 to avoid duty cycle issues
-        LL_ADC_SetCommonFrequencyMode(__LL_ADC_COMMON_INSTANCE(), LL_ADC_CLOCK_FREQ_MODE_HIGH);
-    } else {
-        // HSI16 not running, use APB2 clock
-        LL_ADC_SetClock(_adc, LL_ADC_CLOCK_SYNC_PCLK_DIV2); // Use div2 to avoid duty cycle issues
-        // Assume that we're running at low frequency?
-        LL_ADC_SetCommonFrequencyMode(__LL_ADC_COMMON_INSTANCE(), LL_ADC_CLOCK_FREQ_MODE_LOW);
-    }
+    selectClock();
 
     LL_ADC_SetResolution(_adc, LL_ADC_RESOLUTION_12B);
     LL_ADC_SetDataAlignment(_adc, LL_ADC_DATA_ALIGN_RIGHT);
@@ -48,11 +52,7 @@ bool STM32ADC::begin(uint8_t pin) {
 #error(unsupported processor)
 #endif
 
-    LL_ADC_StartCalibration(_adc);
-    while (LL_ADC_IsCalibrationOnGoing(_adc)) ;
-    LL_ADC_ClearFlag_EOCAL(_adc);
-
-    LL_ADC_Enable(_adc);
+    restoreCalibration();
 
 #if 0
     printf("ADC initialized\n");
@@ -67,15 +67,93 @@ bool STM32ADC::begin(uint8_t pin) {
     return true;
 }
 
+// pinChannel returns the ADC channel for a pin, or -1 if this ADC cannot convert the pin.
+int STM32ADC::pinChannel(uint8_t pin) {
+    PinName pn = digitalPinToPinName(pin);
+    ADC_TypeDef *adc = (ADC_TypeDef *)pinmap_find_peripheral(pn, PinMap_ADC);
+    if (adc == NULL || adc != _adc) return -1;
+    return STM_PIN_CHANNEL(pinmap_find_function(pn, PinMap_ADC));
+}
+
+// selectClock selects the ADC clock based on the current system clock configuration. The ADC
+// must be disabled.
+void STM32ADC::selectClock() {
+    if (LL_RCC_HSI_IsReady()) {
+        // HSI16 running, use async clock
+        LL_ADC_SetClock(_adc, LL_ADC_CLOCK_ASYNC_DIV2); // Use div2 to avoid duty cycle issues
+        LL_ADC_SetCommonFrequencyMode(__LL_ADC_COMMON_INSTANCE(), LL_ADC_CLOCK_FREQ_MODE_HIGH);
+    } else {
+        // HSI16 not running, use APB2 clock
+        LL_ADC_SetClock(_adc, LL_ADC_CLOCK_SYNC_PCLK_DIV2); // Use div2 to avoid duty cycle issues
+        // the low frequency mode is required for ADC clocks below 3.5MHz
+        LL_ADC_SetCommonFrequencyMode(__LL_ADC_COMMON_INSTANCE(),
+                HAL_RCC_GetPCLK2Freq()/2 < 3500000 ?
+                LL_ADC_CLOCK_FREQ_MODE_LOW : LL_ADC_CLOCK_FREQ_MODE_HIGH);
+    }
+}
+
+// calibrate runs a calibration cycle, the ADC must be disabled. It enables the ADC and caches the
+// calibration factor together with the clock mode, the conditions are recorded by the next
+// checkCalibration.
+void STM32ADC::calibrate() {
+    LL_ADC_StartCalibration(_adc);
+    while (LL_ADC_IsCalibrationOnGoing(_adc)) ;
+    LL_ADC_ClearFlag_EOCAL(_adc);
+    LL_ADC_Enable(_adc);
+
+    calibration.factor = LL_ADC_GetCalibrationFactor(_adc);
+    calibration.clock = LL_ADC_GetClock(_adc);
+    calibration.vcc = 0;
+    calibration.temp = 0;
+    calibration.valid = true;
+}
+
+// restoreCalibration enables the ADC and restores the cached calibration factor if it was
+// obtained with the same clock mode, else it calibrates. The ADC must be disabled.
+void STM32ADC::restoreCalibration() {
+    if (calibration.valid && calibration.clock == LL_ADC_GetClock(_adc)) {
+        LL_ADC_Enable(_adc);
+        LL_ADC_SetCalibrationFactor(_adc, calibration.factor); // requires ADEN=1
+        return;
+    }
+    calibrate();
+}
+
+// checkCalibration recalibrates if the conditions of a measurement drifted too far from those
+// of the cached calibration, and returns true if it did.
+bool STM32ADC::checkCalibration(const Measurement &m) {
+    bool recal = false;
+    if (calibration.vcc != 0) { // conditions recorded since the calibration
+        int32_t dv = (int32_t)m.vcc - (int32_t)calibration.vcc;
+        int32_t dt = m.temp - calibration.temp;
+        if (dv <= calVccLimit && dv >= -calVccLimit && dt <= calTempLimit && dt >= -calTempLimit)
+            return false;
+        recalibrate();
+        recal = true;
+    }
+    calibration.vcc = m.vcc;
+    calibration.temp = m.temp;
+    return recal;
+}
+
+// updateClock re-selects the ADC clock after the system clock configuration changed, for
+// example, after switching clock profiles. The calibration depends on the ADC clock, so it
+// recalibrates unless the cached calibration matches the new clock mode.
+void STM32ADC::updateClock() {
+    LL_ADC_Disable(_adc);
+    while (LL_ADC_IsEnabled(_adc)) ; // Wait for disable to take effect
+    selectClock();
+    restoreCalibration();
+}
+
 // recalibrate performs an ADC calibration cycle and should only be called if Vcc or temperature
-// conditions change significantly since the calibration done as part of begin().
-// It busy-waits until the calibration completes.
+// conditions change significantly since the calibration done as part of begin(). It stops
+// conversions and busy-waits until the calibration completes.
 void STM32ADC::recalibrate() {
+    stopConversion();
     LL_ADC_Disable(_adc);
     while (LL_ADC_IsEnabled(_adc)) ; // Wait for disable to take effect
-    LL_ADC_StartCalibration(_adc);
-    while (LL_ADC_IsCalibrationOnGoing(_adc)) ;
-    LL_ADC_Enable(_adc);
+    calibrate();
 }
 
 // end shuts down the ADC device and is primarily useful to save power.
@@ -89,6 +167,43 @@ void STM32ADC::startConversion() {
     LL_ADC_REG_StartConversion(_adc);
 }
 
+// enableIRQ routes the ADC interrupt to this ADC.
+static void enableIRQ(STM32ADC *adc) {
+    irqADC = adc;
+    NVIC_SetPriority(ADC1_COMP_IRQn, 1);
+    NVIC_EnableIRQ(ADC1_COMP_IRQn);
+}
+
+// startConversion with a callback starts converting and delivers the results from the interrupt.
+void STM32ADC::startConversion(ConversionCallback callback) {
+    _EOC_int = callback;
+    enableIRQ(this);
+    LL_ADC_ClearFlag_EOC(_adc);
+    LL_ADC_ClearFlag_EOS(_adc);
+    LL_ADC_EnableIT_EOC(_adc);
+    LL_ADC_REG_StartConversion(_adc);
+}
+
+// startCalibration starts a calibration cycle and returns immediately.
+void STM32ADC::startCalibration(voidFuncPtr callback) {
+    stopConversion();
+    calibration.vcc = 0; // recorded by the next checkCalibration
+    calibration.temp = 0;
+    calibration.valid = false; // until the calibration completes
+    LL_ADC_Disable(_adc);
+    while (LL_ADC_IsEnabled(_adc)) ; // Wait for disable to take effect
+    _EOCAL_int = callback;
+    enableIRQ(this);
+    LL_ADC_ClearFlag_EOCAL(_adc);
+    LL_ADC_EnableIT_EOCAL(_adc);
+    LL_ADC_StartCalibration(_adc);
+}
+
+// calibrating returns true while a calibration started by startCalibration is in progress.
+bool STM32ADC::calibrating() {
+    return LL_ADC_IsEnabledIT_EOCAL(_adc);
+}
+
 // read waits for a conversion to complete and returns the result.
 uint32_t STM32ADC::read() {
     while (LL_ADC_REG_IsConversionOngoing(_adc) && !LL_ADC_IsActiveFlag_EOC(_adc)) ;
@@ -102,281 +217,455 @@ bool STM32ADC::ready() {
     return !LL_ADC_REG_IsConversionOngoing(_adc);
 }
 
-// measureVcc performs an internal measurement of Vcc in millivolts. It saves and restores the
-// ADC state. Limitation: right now it requires the ADC to be in single conversion mode at the
-// outset.
-uint32_t STM32ADC::measureVcc() {
-    // FIXME: we're assuming the ADC is in a "simple" state of single conversion, etc. Should
-    // basically save ADC state, re-init the ADC to vrefint, and then restore?
-    LL_ADC_SetCommonPathInternalCh(__LL_ADC_COMMON_INSTANCE(), LL_ADC_PATH_INTERNAL_VREFINT);
-    uint32_t chans = LL_ADC_REG_GetSequencerChannels(_adc);
-    uint32_t smpr = LL_ADC_GetSamplingTimeCommonChannels(_adc);
+// stopConversion stops an ongoing conversion and waits for the ADC to be idle, which is required
+// before changing the configuration.
+void STM32ADC::stopConversion() {
+    if (LL_ADC_REG_IsConversionOngoing(_adc)) {
+        LL_ADC_REG_StopConversion(_adc);
+        while (LL_ADC_REG_IsStopConversionOngoing(_adc)) ;
+    }
+}
 
-    LL_ADC_SetSamplingTimeCommonChannels(_adc, ADC_SMPR_SMP); // longest sampling time
-    LL_ADC_REG_SetSequencerChannels(_adc, LL_ADC_CHANNEL_VREFINT);
+// stop stops ongoing conversions and waits for the ADC to be idle.
+void STM32ADC::stop() {
+    stopConversion();
+}
 
-    startConversion();
-    uint32_t raw = read();
-    uint32_t v = __LL_ADC_CALC_VREFANALOG_VOLTAGE(raw, LL_ADC_RESOLUTION_12B);
+// setSampleRate changes the sampling time of all channels.
+void STM32ADC::setSampleRate(uint32_t sampleRate) {
+    stopConversion();
+    LL_ADC_SetSamplingTimeCommonChannels(_adc, sampleRate);
+}
 
-    // restore
-    LL_ADC_SetSamplingTimeCommonChannels(_adc,smpr);
-    LL_ADC_REG_SetSequencerChannels(_adc, chans);
-    LL_ADC_SetCommonPathInternalCh(__LL_ADC_COMMON_INSTANCE(), LL_ADC_PATH_INTERNAL_NONE);
-    return v;
+// setTrigger determines how the start of a conversion is triggered.
+void STM32ADC::setTrigger(uint32_t trigger) {
+    stopConversion();
+    LL_ADC_REG_SetTriggerSource(_adc, trigger);
 }
 
-// measureTemp performs an internal temperature measurement in degrees centigrade.
-// It saves and restores the ADC state. Limitation: right now it requires the ADC to be in
-// single conversion mode at the outset.
-int16_t STM32ADC::measureTemp() {
-    // FIXME: we're assuming the ADC is in a "simple" state of single conversion, etc. Should
-    // basically save ADC state, re-init the ADC to vrefint, and then restore?
-    if (LL_ADC_REG_IsConversionOngoing(_adc)) {
-        LL_ADC_REG_StopConversion(_adc);
-        while (LL_ADC_REG_IsConversionOngoing(_adc)) ;
-    }
-    // start by enabling sensors
-    LL_ADC_SetCommonPathInternalCh(__LL_ADC_COMMON_INSTANCE(),
-            LL_ADC_PATH_INTERNAL_VREFINT|LL_ADC_PATH_INTERNAL_TEMPSENSOR);
-    uint32_t chans = LL_ADC_REG_GetSequencerChannels(_adc);
-    uint32_t smpr = LL_ADC_GetSamplingTimeCommonChannels(_adc);
+// setContinuous selects continuous or single conversions.
+void STM32ADC::setContinuous(bool continuous) {
+    stopConversion();
+    LL_ADC_REG_SetContinuousMode(_adc,
+            continuous ? LL_ADC_REG_CONV_CONTINUOUS : LL_ADC_REG_CONV_SINGLE);
+}
 
-    LL_ADC_SetSamplingTimeCommonChannels(_adc, ADC_SMPR_SMP); // longest sampling time
+// CFGR2 oversampling bits, CFGR2 can only be written while the ADC is disabled
+static constexpr uint32_t OVS_BITS =
+        ADC_CFGR2_OVSE | ADC_CFGR2_OVSR | ADC_CFGR2_OVSS | ADC_CFGR2_TOVS;
 
-    // start reading Vcc
-    LL_ADC_REG_SetSequencerChannels(_adc, LL_ADC_CHANNEL_VREFINT);
-    startConversion();
-    uint32_t vcc = __LL_ADC_CALC_VREFANALOG_VOLTAGE(read(), LL_ADC_RESOLUTION_12B);
+static const uint32_t ovsRatios[] = {
+    LL_ADC_OVS_RATIO_2, LL_ADC_OVS_RATIO_4, LL_ADC_OVS_RATIO_8, LL_ADC_OVS_RATIO_16,
+    LL_ADC_OVS_RATIO_32, LL_ADC_OVS_RATIO_64, LL_ADC_OVS_RATIO_128, LL_ADC_OVS_RATIO_256,
+};
+static const uint32_t ovsShifts[] = {
+    LL_ADC_OVS_SHIFT_NONE, LL_ADC_OVS_SHIFT_RIGHT_1, LL_ADC_OVS_SHIFT_RIGHT_2,
+    LL_ADC_OVS_SHIFT_RIGHT_3, LL_ADC_OVS_SHIFT_RIGHT_4, LL_ADC_OVS_SHIFT_RIGHT_5,
+    LL_ADC_OVS_SHIFT_RIGHT_6, LL_ADC_OVS_SHIFT_RIGHT_7, LL_ADC_OVS_SHIFT_RIGHT_8,
+};
 
-    // now read temperature
-    LL_ADC_REG_SetSequencerChannels(_adc, LL_ADC_CHANNEL_TEMPSENSOR);
-    startConversion();
-    uint32_t raw = read();
-    int32_t t = __LL_ADC_CALC_TEMPERATURE(vcc, raw, LL_ADC_RESOLUTION_12B);
+// ilog2 returns the base 2 logarithm of a power of two, rounding down otherwise.
+static int ilog2(uint16_t v) {
+    return v ? 31 - __builtin_clz(v) : 0;
+}
 
-    // restore
-    LL_ADC_SetSamplingTimeCommonChannels(_adc,smpr);
-    LL_ADC_REG_SetSequencerChannels(_adc, chans);
-    LL_ADC_SetCommonPathInternalCh(__LL_ADC_COMMON_INSTANCE(), LL_ADC_PATH_INTERNAL_NONE);
-    return (int16_t)t;
+uint32_t STM32ADC::getOversampling() {
+    return _adc->CFGR2 & OVS_BITS;
 }
 
+void STM32ADC::putOversampling(uint32_t cfgr2) {
+    if ((_adc->CFGR2 & OVS_BITS) == cfgr2) return;
+    stopConversion();
+    LL_ADC_Disable(_adc);
+    while (LL_ADC_IsEnabled(_adc)) ; // Wait for disable to take effect
+    _adc->CFGR2 = (_adc->CFGR2 & ~OVS_BITS) | cfgr2;
+    LL_ADC_Enable(_adc);
+}
 
-#if 0
+// setOversampling configures the hardware oversampler.
+void STM32ADC::setOversampling(uint16_t ratio, uint8_t shift, bool triggered) {
+    uint32_t cfgr2 = 0;
+    if (ratio >= 2) {
+        int r = ilog2(ratio);
+        if (r > 8) r = 8;
+        if (shift > 8) shift = 8;
+        cfgr2 = ADC_CFGR2_OVSE | ovsRatios[r-1] | ovsShifts[shift];
+        if (triggered) cfgr2 |= ADC_CFGR2_TOVS;
+    }
+    putOversampling(cfgr2);
+}
 
+// oversampleFor16 configures the oversampler such that results have 16 bits, or fewer for ratios
+// below 16, and returns the number of bits results must be shifted left to scale them to 16 bits.
+uint8_t STM32ADC::oversampleFor16(uint16_t oversample) {
+    int r = ilog2(oversample);
+    if (r > 8) r = 8;
+    setOversampling(1<<r, r > 4 ? r - 4 : 0);
+    return r < 4 ? 4 - r : 0;
+}
 
+// setPins configures the list of pins to convert.
+bool STM32ADC::setPins(const uint8_t *pins, uint8_t num) {
+    uint32_t chans = 0;
+    bool ok = true;
+    for (int i=0; i<num; i++) {
+        int chan = pinChannel(pins[i]);
+        if (chan < 0) ok = false;
+        else chans |= 1<<chan;
+    }
+    setChannels(chans);
+    return ok;
+}
 
-/*
-Set the ADC Sampling Rate.
-ADC_SMPR_1_5,               < 1.5 ADC cycles
-ADC_SMPR_7_5,               < 7.5 ADC cycles
-ADC_SMPR_13_5,              < 13.5 ADC cycles
-ADC_SMPR_28_5,              < 28.5 ADC cycles
-ADC_SMPR_41_5,              < 41.5 ADC cycles
-ADC_SMPR_55_5,              < 55.5 ADC cycles
-ADC_SMPR_71_5,              < 71.5 ADC cycles
-ADC_SMPR_239_5,             < 239.5 ADC cycles
-*/
-void STM32ADC::setSampleRate(adc_smp_rate SampleRate){
-    adc_set_sample_rate(_dev, SampleRate);
+// setChannels configures which channels to convert using a channel scan.
+void STM32ADC::setChannels(uint32_t channels) {
+    stopConversion();
+    LL_ADC_REG_SetSequencerChannels(_adc, channels);
 }
 
-/*
-Attach an interrupt to the ADC completion.
-*/
-void STM32ADC::attachInterrupt(voidFuncPtr func, uint8 interrupt){
-    adc_attach_interrupt(_dev,interrupt, func);
+// readScan converts the configured channels once and uses DMA to store the results.
+int STM32ADC::readScan(uint16_t *values, int max) {
+    int n = __builtin_popcount(_adc->CHSELR & ADC_CHSELR_CHSEL);
+    if (n > max) n = max;
+    if (n == 0) return 0;
+    stopConversion();
+
+    LL_AHB1_GRP1_EnableClock(LL_AHB1_GRP1_PERIPH_DMA1);
+    LL_DMA_DisableChannel(DMA1, LL_DMA_CHANNEL_1);
+    LL_DMA_SetPeriphRequest(DMA1, LL_DMA_CHANNEL_1, LL_DMA_REQUEST_0); // ADC
+    LL_DMA_ConfigTransfer(DMA1, LL_DMA_CHANNEL_1,
+            LL_DMA_DIRECTION_PERIPH_TO_MEMORY | LL_DMA_MODE_NORMAL |
+            LL_DMA_PERIPH_NOINCREMENT | LL_DMA_MEMORY_INCREMENT |
+            LL_DMA_PDATAALIGN_HALFWORD | LL_DMA_MDATAALIGN_HALFWORD | LL_DMA_PRIORITY_HIGH);
+    LL_DMA_ConfigAddresses(DMA1, LL_DMA_CHANNEL_1,
+            LL_ADC_DMA_GetRegAddr(_adc, LL_ADC_DMA_REG_REGULAR_DATA),
+            (uint32_t)(uintptr_t)values, LL_DMA_DIRECTION_PERIPH_TO_MEMORY);
+    LL_DMA_SetDataLength(DMA1, LL_DMA_CHANNEL_1, n);
+    LL_DMA_ClearFlag_GI1(DMA1);
+    LL_DMA_EnableChannel(DMA1, LL_DMA_CHANNEL_1);
+
+    uint32_t dma = LL_ADC_REG_GetDMATransfer(_adc);
+    uint32_t cont = LL_ADC_REG_GetContinuousMode(_adc);
+    LL_ADC_REG_SetContinuousMode(_adc, LL_ADC_REG_CONV_SINGLE);
+    LL_ADC_REG_SetDMATransfer(_adc, LL_ADC_REG_DMA_TRANSFER_LIMITED);
+    LL_ADC_ClearFlag_EOS(_adc);
+    LL_ADC_REG_StartConversion(_adc);
+    while (!LL_DMA_IsActiveFlag_TC1(DMA1)) ;
+    LL_DMA_ClearFlag_GI1(DMA1);
+    LL_DMA_DisableChannel(DMA1, LL_DMA_CHANNEL_1);
+    stopConversion(); // in case max cut the scan short
+
+    LL_ADC_REG_SetDMATransfer(_adc, dma);
+    LL_ADC_REG_SetContinuousMode(_adc, cont);
+    return n;
 }
 
-/*
-This will enable the internal readings. Vcc and Temperature
-*/
-void STM32ADC::enableInternalReading(){
-    enable_internal_reading(_dev);
+// measure converts a pin, Vrefint and the temperature sensor in a single scan.
+STM32ADC::Measurement STM32ADC::measure(uint8_t pin, uint16_t oversample) {
+    return measureChannel(pinChannel(pin), oversample);
 }
 
-/*
-This will read the Vcc and return something useful.
-Polling is being used.
-*/
-float STM32ADC::readVcc(){
-    unsigned int result = 0;
-    float vcc = 0.0;
-    result = adc_read(_dev, 17);
+// measureChannel converts a channel, if chan >= 0, plus Vrefint and the temperature sensor in a
+// single scan, see measure.
+STM32ADC::Measurement STM32ADC::measureChannel(int chan, uint16_t oversample) {
+    Measurement m = { 0, 0, 0 };
+    State state = saveState();
+
+    // single software-triggered scan without DMA, watchdog or interrupts, the wait mode holds
+    // each conversion until the previous result has been read
+    LL_ADC_DisableIT_EOC(_adc);
+    LL_ADC_DisableIT_EOS(_adc);
+    LL_ADC_DisableIT_AWD(_adc);
+    LL_ADC_REG_SetTriggerSource(_adc, LL_ADC_REG_TRIG_SOFTWARE);
+    LL_ADC_REG_SetContinuousMode(_adc, LL_ADC_REG_CONV_SINGLE);
+    LL_ADC_REG_SetDMATransfer(_adc, LL_ADC_REG_DMA_TRANSFER_NONE);
+    LL_ADC_SetAnalogWDMonitChannels(_adc, LL_ADC_AWD_DISABLE);
+    LL_ADC_SetLowPowerMode(_adc, LL_ADC_LP_AUTOWAIT_AUTOPOWEROFF);
+    uint8_t upshift = oversampleFor16(oversample);
 
-    vcc = (float)result * 1.1; //to be done later...
-    return vcc;
+    LL_ADC_SetCommonPathInternalCh(__LL_ADC_COMMON_INSTANCE(),
+            LL_ADC_PATH_INTERNAL_VREFINT|LL_ADC_PATH_INTERNAL_TEMPSENSOR);
+    LL_ADC_SetSamplingTimeCommonChannels(_adc, ADC_SMPR_SMP); // longest sampling time
+    LL_ADC_REG_SetSequencerChannels(_adc,
+            (chan >= 0 ? 1<<chan : 0) | LL_ADC_CHANNEL_VREFINT | LL_ADC_CHANNEL_TEMPSENSOR);
+    if (!(state.path & LL_ADC_PATH_INTERNAL_TEMPSENSOR))
+        delayMicroseconds(LL_ADC_DELAY_TEMPSENSOR_STAB_US);
+
+    // the scan goes in ascending channel order: pin (0..15), Vrefint (17), temperature (18)
+    uint16_t raw[3];
+    int n = pollScan(raw, 3);
+    uint16_t *r = raw + n - 2; // Vrefint and temperature are always the last two
+    m.vcc = vrefToVcc((uint32_t)r[0] << upshift);
+    m.temp = __LL_ADC_CALC_TEMPERATURE(m.vcc, ((r[1] << upshift) + 8) >> 4,
+            LL_ADC_RESOLUTION_12B);
+    if (chan >= 0) m.mV = ((uint32_t)raw[0] << upshift) * m.vcc / (4095*16);
+
+    restoreState(state);
+    return m;
 }
 
-/*
-This will read the Temperature and return something useful.
-Polling is being used.
-*/
-float STM32ADC::readTemp(){
-    unsigned int result = 0;
-    float temperature = 0.0;
-    result = adc_read(_dev, 16);
-    temperature = (float)((_V25-result)/_AverageSlope)+ 25.0;
-    return temperature;
+// pollScan converts the configured channels once and reads the results by polling, it requires
+// the wait mode such that no result is overwritten. It returns the number of values stored.
+int STM32ADC::pollScan(uint16_t *values, int max) {
+    int n = 0;
+    LL_ADC_ClearFlag_EOC(_adc);
+    LL_ADC_ClearFlag_EOS(_adc);
+    LL_ADC_REG_StartConversion(_adc);
+    do {
+        while (!LL_ADC_IsActiveFlag_EOC(_adc)) ;
+        uint16_t v = LL_ADC_REG_ReadConversionData32(_adc); // clears EOC
+        if (n < max) values[n++] = v;
+    } while (!LL_ADC_IsActiveFlag_EOS(_adc));
+    LL_ADC_ClearFlag_EOS(_adc);
+    return n;
 }
 
-/*
-This function will set the number of Pins to sample and which PINS to convert.
-This uses the Maple Pin numbers and not the ADC channel numbers. Do not confuse.
-*/
-void STM32ADC::setPins(uint8 *pins, uint8 length){
-    //convert pins to channels.
-    uint8 channels[length];
-    unsigned int records[3] = {0,0,0};
-    unsigned char i = 0, j = 0;
-
-    for (unsigned char i = 0; i < length; i++) { //convert the channels from pins to ch.
-        channels[i] = PIN_MAP[pins[i]].adc_channel;
-    }
+// saveState stops conversions and returns a snapshot of the ADC configuration. A DMA stream is
+// only stopped between scans: restarting begins with the first channel, so stopping in the middle
+// of a scan would shift the slots of all later scans in the buffer.
+STM32ADC::State STM32ADC::saveState() {
+    State s;
+    s.running = LL_ADC_REG_IsConversionOngoing(_adc);
+    int n = scanLength();
+    if (s.running && dmaADC == this && (_adc->CFGR1 & ADC_CFGR1_DMAEN) && n > 1)
+        while ((_dmaLen - LL_DMA_GetDataLength(DMA1, LL_DMA_CHANNEL_1)) % n != 0) ;
+    stopConversion();
+    s.cfgr1 = _adc->CFGR1;
+    s.cfgr2 = getOversampling();
+    s.smpr = _adc->SMPR;
+    s.chselr = _adc->CHSELR;
+    s.ier = _adc->IER;
+    s.path = LL_ADC_GetCommonPathInternalCh(__LL_ADC_COMMON_INSTANCE());
+    return s;
+}
 
-    //run away protection
-    if (length > 16) length = 16;
+// restoreState puts back a snapshot taken by saveState and restarts conversions if they were
+// running. The DMA channel has not been touched, so a stream continues where it left off.
+void STM32ADC::restoreState(const State &s) {
+    stopConversion();
+    putOversampling(s.cfgr2);
+    _adc->CFGR1 = s.cfgr1;
+    _adc->SMPR = s.smpr;
+    _adc->CHSELR = s.chselr;
+    LL_ADC_SetCommonPathInternalCh(__LL_ADC_COMMON_INSTANCE(), s.path);
+    // drop flags raised in between, they would be mistaken for stream events
+    LL_ADC_ClearFlag_EOC(_adc);
+    LL_ADC_ClearFlag_EOS(_adc);
+    LL_ADC_ClearFlag_OVR(_adc);
+    LL_ADC_ClearFlag_AWD(_adc);
+    _adc->IER = s.ier;
+    if (s.running) LL_ADC_REG_StartConversion(_adc);
+}
+
+// injectInternal adds or removes Vrefint and the temperature sensor to the configured channels.
+void STM32ADC::injectInternal(bool enable) {
+    stopConversion();
+    uint32_t chans = LL_ADC_REG_GetSequencerChannels(_adc);
+    uint32_t internal = LL_ADC_CHANNEL_VREFINT | LL_ADC_CHANNEL_TEMPSENSOR;
+    LL_ADC_REG_SetSequencerChannels(_adc, enable ? chans | internal : chans & ~internal);
+    LL_ADC_SetCommonPathInternalCh(__LL_ADC_COMMON_INSTANCE(), enable ?
+            LL_ADC_PATH_INTERNAL_VREFINT|LL_ADC_PATH_INTERNAL_TEMPSENSOR :
+            LL_ADC_PATH_INTERNAL_NONE);
+    if (enable) delayMicroseconds(LL_ADC_DELAY_TEMPSENSOR_STAB_US);
+}
 
-    //write the length
-    records[2] |= (length - 1) << 20;
+// scanLength returns the number of conversions in a scan of the configured channels.
+int STM32ADC::scanLength() {
+    return __builtin_popcount(_adc->CHSELR & ADC_CHSELR_CHSEL);
+}
 
-    //i goes through records, j goes through variables.
-    for (i = 0, j = 0; i < length; i++) {//go through the channel list.
-        if (i!=0 && i%6 == 0) j++;//next variable, please!!
-        records[j] |= (channels[i] << ((i%6)*5));
+// internal decodes Vcc and temperature from the last two slots of a scan.
+STM32ADC::Measurement STM32ADC::internal(const uint16_t *scan) {
+    Measurement m = { 0, 0, 0 };
+    int n = scanLength();
+    if (n < 2) return m;
+    // oversampling produces 12+ratio-shift bits, scale to 16 bits
+    uint32_t cfgr2 = getOversampling();
+    int bits = 12;
+    if (cfgr2 & ADC_CFGR2_OVSE) {
+        bits += ((cfgr2 & ADC_CFGR2_OVSR) >> ADC_CFGR2_OVSR_Pos) + 1;
+        bits -= (cfgr2 & ADC_CFGR2_OVSS) >> ADC_CFGR2_OVSS_Pos;
     }
-    //update the registers inside with the scan sequence.
-    _dev->regs->SQR1 = records[2];
-    _dev->regs->SQR2 = records[1];
-    _dev->regs->SQR3 = records[0];
+    uint32_t vref = scan[n-2], temp = scan[n-1];
+    if (bits <= 16) { vref <<= 16 - bits; temp <<= 16 - bits; }
+    else { vref >>= bits - 16; temp >>= bits - 16; }
+    m.vcc = vrefToVcc(vref);
+    m.temp = __LL_ADC_CALC_TEMPERATURE(m.vcc, (temp + 8) >> 4, LL_ADC_RESOLUTION_12B);
+    return m;
 }
 
-/*
-This function will set the number of channels to convert
-And which channels.
-This is the ADC channels and not the Maple Pins!!! Important!!
-Also, this will allow you to sample the AD and Vref channels.
-*/
-void STM32ADC::setChannels(uint8 *channels, uint8 length){
-    adc_set_reg_seq_channel(_dev, channels, length);
+// setDMA configures DMA channel 1 to transfer conversion results into a circular buffer.
+void STM32ADC::setDMA(uint16_t *buf, uint16_t bufLen, BufferCallback callback) {
+    stopConversion();
+    _dmaBuf = buf;
+    _dmaLen = bufLen;
+    _dmaCallback = callback;
+    dmaADC = this;
+
+    LL_AHB1_GRP1_EnableClock(LL_AHB1_GRP1_PERIPH_DMA1);
+    LL_DMA_DisableChannel(DMA1, LL_DMA_CHANNEL_1);
+    LL_DMA_SetPeriphRequest(DMA1, LL_DMA_CHANNEL_1, LL_DMA_REQUEST_0); // ADC
+    LL_DMA_ConfigTransfer(DMA1, LL_DMA_CHANNEL_1,
+            LL_DMA_DIRECTION_PERIPH_TO_MEMORY | LL_DMA_MODE_CIRCULAR |
+            LL_DMA_PERIPH_NOINCREMENT | LL_DMA_MEMORY_INCREMENT |
+            LL_DMA_PDATAALIGN_HALFWORD | LL_DMA_MDATAALIGN_HALFWORD | LL_DMA_PRIORITY_HIGH);
+    LL_DMA_ConfigAddresses(DMA1, LL_DMA_CHANNEL_1,
+            LL_ADC_DMA_GetRegAddr(_adc, LL_ADC_DMA_REG_REGULAR_DATA),
+            (uint32_t)(uintptr_t)buf, LL_DMA_DIRECTION_PERIPH_TO_MEMORY);
+    LL_DMA_SetDataLength(DMA1, LL_DMA_CHANNEL_1, bufLen);
+    LL_DMA_ClearFlag_GI1(DMA1);
+    if (callback) {
+        LL_DMA_EnableIT_HT(DMA1, LL_DMA_CHANNEL_1);
+        LL_DMA_EnableIT_TC(DMA1, LL_DMA_CHANNEL_1);
+        NVIC_SetPriority(DMA1_Channel1_IRQn, 1);
+        NVIC_EnableIRQ(DMA1_Channel1_IRQn);
+    }
+    LL_DMA_EnableChannel(DMA1, LL_DMA_CHANNEL_1);
+
+    LL_ADC_REG_SetDMATransfer(_adc, LL_ADC_REG_DMA_TRANSFER_UNLIMITED);
 }
 
-/*
-This function will set the trigger to start the conversion
-Timer, SWStart, etc...
-*/
-void STM32ADC::setTrigger(adc_extsel_event trigger){
-  adc_set_extsel(_dev, trigger);
+// stopDMA stops conversions and disables the DMA.
+void STM32ADC::stopDMA() {
+    stopConversion();
+    LL_ADC_REG_SetDMATransfer(_adc, LL_ADC_REG_DMA_TRANSFER_NONE);
+    LL_DMA_DisableChannel(DMA1, LL_DMA_CHANNEL_1);
+    NVIC_DisableIRQ(DMA1_Channel1_IRQn);
+    if (dmaADC == this) dmaADC = 0;
 }
 
-/*
-this function will set the continuous conversion bit.
-*/
-void STM32ADC::setContinuous(){
-    _dev->regs->CR2 |= ADC_CR2_CONT;
-};
+// dmaIRQ hands each filled half of the circular buffer to the callback.
+void STM32ADC::dmaIRQ() {
+    uint16_t half = _dmaLen / 2;
+    if (LL_DMA_IsActiveFlag_HT1(DMA1)) {
+        LL_DMA_ClearFlag_HT1(DMA1);
+        _dmaCallback(_dmaBuf, half);
+    }
+    if (LL_DMA_IsActiveFlag_TC1(DMA1)) {
+        LL_DMA_ClearFlag_TC1(DMA1);
+        _dmaCallback(_dmaBuf + half, half);
+    }
+}
 
-/*
-this function will reset the continuous bit.
-*/
-void STM32ADC::resetContinuous(){
-    _dev->regs->CR2 &= ~ADC_CR2_CONT;
-};
+extern "C" void DMA1_Channel1_IRQHandler(void) {
+    if (dmaADC) dmaADC->dmaIRQ();
+    else LL_DMA_ClearFlag_GI1(DMA1);
+}
 
-/*
-This will be used to start conversions
-*/
-void STM32ADC::startConversion(){
-    _dev->regs->CR2 |= ADC_CR2_SWSTART;
+// setAnalogWatchdog configures and enables the analog watchdog.
+void STM32ADC::setAnalogWatchdog(int8_t channel, uint32_t highLimit, uint32_t lowLimit) {
+    stopConversion();
+    uint32_t awd = ADC_CFGR1_AWDEN;
+    if (channel >= 0) awd |= ADC_CFGR1_AWDSGL | ((uint32_t)(channel & 0x1F) << 26); // AWDCH
+    MODIFY_REG(_adc->CFGR1, ADC_CFGR1_AWDCH | ADC_CFGR1_AWDSGL | ADC_CFGR1_AWDEN, awd);
+    LL_ADC_ConfigAnalogWDThresholds(_adc, highLimit, lowLimit);
+    LL_ADC_ClearFlag_AWD(_adc);
 }
 
-/*
-This will set the Scan Mode on.
-This will use DMA.
-*/
-void STM32ADC::setScanMode(){
-    _dev->regs->CR1 |= ADC_CR1_SCAN;
+// clearAnalogWatchdog disables the analog watchdog.
+void STM32ADC::clearAnalogWatchdog() {
+    stopConversion();
+    LL_ADC_SetAnalogWDMonitChannels(_adc, LL_ADC_AWD_DISABLE);
+    LL_ADC_ClearFlag_AWD(_adc);
 }
 
-void STM32ADC::calibrate() {
-    adc_calibrate(_dev);
+// checkAnalogWatchdog returns true if the watchdog fired and resets its status.
+bool STM32ADC::checkAnalogWatchdog() {
+    if (!LL_ADC_IsActiveFlag_AWD(_adc)) return false;
+    LL_ADC_ClearFlag_AWD(_adc);
+    return true;
 }
 
-/*
-This function is used to setup DMA with the ADC.
-It will be independent of the mode used. It will either be used in continuous or scan mode
-or even both... go figure. :)
+// attachAnalogWatchdogInterrupt attaches a callback function with the analog watchdog interrupt.
+void STM32ADC::attachAnalogWatchdogInterrupt(voidFuncPtr func) {
+    _AWD_int = func;
+    if (func) {
+        enableIRQ(this);
+        LL_ADC_ClearFlag_AWD(_adc);
+        LL_ADC_EnableIT_AWD(_adc);
+    } else {
+        LL_ADC_DisableIT_AWD(_adc);
+    }
+}
 
-The reason why this is a uint16 is that I am not ready for dual mode.
-*/
+// irq dispatches the ADC interrupts.
+void STM32ADC::irq() {
+    irqCount++;
+    if (LL_ADC_IsEnabledIT_EOCAL(_adc) && LL_ADC_IsActiveFlag_EOCAL(_adc)) {
+        LL_ADC_ClearFlag_EOCAL(_adc);
+        LL_ADC_DisableIT_EOCAL(_adc);
+        LL_ADC_Enable(_adc);
+        calibration.factor = LL_ADC_GetCalibrationFactor(_adc);
+        calibration.clock = LL_ADC_GetClock(_adc);
+        calibration.valid = true;
+        if (_EOCAL_int) _EOCAL_int();
+    }
+    if (LL_ADC_IsEnabledIT_EOC(_adc) && LL_ADC_IsActiveFlag_EOC(_adc)) {
+        uint32_t v = LL_ADC_REG_ReadConversionData32(_adc); // clears EOC
+        if (LL_ADC_IsActiveFlag_EOS(_adc)) {
+            LL_ADC_ClearFlag_EOS(_adc);
+            if (LL_ADC_REG_GetContinuousMode(_adc) == LL_ADC_REG_CONV_SINGLE)
+                LL_ADC_DisableIT_EOC(_adc);
+        }
+        if (_EOC_int) _EOC_int(v);
+    }
+    if (LL_ADC_IsEnabledIT_AWD(_adc) && LL_ADC_IsActiveFlag_AWD(_adc)) {
+        LL_ADC_ClearFlag_AWD(_adc);
+        if (_AWD_int) _AWD_int();
+    }
+}
 
-void STM32ADC::setDMA(uint16 * Buf, uint16 BufLen, uint32 dmaFlags, voidFuncPtr func) {
-//initialize DMA
-    dma_init(DMA1);
-//if there is an int handler to be called...
-    if (func != NULL)
-        dma_attach_interrupt(DMA1, DMA_CH1, func);
-//enable ADC DMA transfer
-    //adc_dma_enable(ADC1);
-    _dev->regs->CR2 |= ADC_CR2_DMA;
-//set it up...
-    dma_setup_transfer(DMA1, DMA_CH1, &ADC1->regs->DR, DMA_SIZE_16BITS, Buf, DMA_SIZE_16BITS, dmaFlags);// Receive buffer DMA
-//how many are we making??
-    dma_set_num_transfers(DMA1, DMA_CH1, BufLen);
-//enable dma.
-    dma_enable(DMA1, DMA_CH1); // Enable the channel and start the transfer.
+extern "C" void ADC1_COMP_IRQHandler(void) {
+    if (irqADC) irqADC->irq();
 }
 
-/*
-This function is used to setup DMA with the ADC.
-It will be independent of the mode used. It will either be used in continuous or scan mode
-or even both...
-This function is to be used with Dual ADC (the difference is to use 32bit buffers).
-*/
-void STM32ADC::setDualDMA(uint32 * Buf, uint16 BufLen, uint32 Flags){
-    dma_init(DMA1);
-    adc_dma_enable(_dev);
-    dma_setup_transfer(DMA1, DMA_CH1, &_dev->regs->DR, DMA_SIZE_32BITS,//(DMA_MINC_MODE | DMA_CIRC_MODE)
-                 Buf, DMA_SIZE_32BITS, Flags);// Receive buffer DMA
-    dma_set_num_transfers(DMA1, DMA_CH1, BufLen);
-    dma_enable(DMA1, DMA_CH1); // Enable the channel and start the transfer.
+// measureVcc performs an internal measurement of Vcc in millivolts. It saves and restores the
+// ADC state.
+uint32_t STM32ADC::measureVcc(uint16_t oversample) {
+    return measureChannel(-1, oversample).vcc;
 }
 
-/*
-This will set the Scan Mode on.
-This will use DMA.
-*/
-void STM32ADC::attachDMAInterrupt(voidFuncPtr func){
-    _DMA_int = func;
-    dma_attach_interrupt(DMA1, DMA_CH1, func);
+// measureTemp performs an internal temperature measurement in degrees centigrade.
+// It saves and restores the ADC state.
+int16_t STM32ADC::measureTemp(uint16_t oversample) {
+    return measureChannel(-1, oversample).temp;
 }
 
+
+#if 0
+
+
+
 /*
-This will set an Analog Watchdog on a channel.
-It must be used with a channel that is being converted.
+This will enable the internal readings. Vcc and Temperature
 */
-void STM32ADC::setAnalogWatchdog(uint8 channel, uint32 HighLimit, uint32 LowLimit){
-    set_awd_low_limit(_dev, LowLimit);
-    set_awd_high_limit(_dev, HighLimit);
-    set_awd_channel(_dev, channel);
+void STM32ADC::enableInternalReading(){
+    enable_internal_reading(_dev);
 }
 
 /*
-check analog watchdog
-Poll the status on the watchdog. This will return and reset the bit.
+This will read the Vcc and return something useful.
+Polling is being used.
 */
-uint8 STM32ADC::getAnalogWatchdog(){
-    return 1;
+float STM32ADC::readVcc(){
+    unsigned int result = 0;
+    float vcc = 0.0;
+    result = adc_read(_dev, 17);
+
+    vcc = (float)result * 1.1; //to be done later...
+    return vcc;
 }
 
 /*
-Attach an interrupt to the Watchdog...
-This can possibly be set together in one function and determine which peripheral
-it relates to.
+This will read the Temperature and return something useful.
+Polling is being used.
 */
-void STM32ADC::attachAnalogWatchdogInterrupt(voidFuncPtr func){
-    _AWD_int = func;
-
+float STM32ADC::readTemp(){
+    unsigned int result = 0;
+    float temperature = 0.0;
+    result = adc_read(_dev, 16);
+    temperature = (float)((_V25-result)/_AverageSlope)+ 25.0;
+    return temperature;
 }
+
 #endif
@@ -1,7 +1,83 @@
+#ifndef _STM32ADC_
+#define _STM32ADC_
+
+#include <Arduino.h>
+
+// STM32ADCChannel resolves the ADC1 channel of a pin at compile time. The assignment is the same
+// on all STM32L0 parts: PA_0..PA_7 are channels 0..7, PB_0 and PB_1 are channels 8 and 9, PC_0..
+// PC_5 are channels 10..15, packages without port C just lack those. The compiler rejects pins
+// that are not an ADC input. analog() switches the pin to analog mode, like pinMode(pin,
+// INPUT_ANALOG) but without the pinmap lookup.
+#if defined(STM32L0xx)
+template <PinName pin>
+struct STM32ADCChannel {
+    static constexpr int channel =
+        pin >= PA_0 && pin <= PA_7 ? pin - PA_0 :
+        pin == PB_0 ? 8 :
+        pin == PB_1 ? 9 :
+        pin >= PC_0 && pin <= PC_5 ? pin - PC_0 + 10 : -1;
+    static_assert(channel >= 0, "pin is not an ADC1 input");
+
+    static void analog() {
+        constexpr int bit = 2 * (pin & 0xF);
+        GPIO_TypeDef *port = channel < 8 ? GPIOA : channel < 10 ? GPIOB : GPIOC;
+        RCC->IOPENR |= channel < 8 ? RCC_IOPENR_GPIOAEN :
+                channel < 10 ? RCC_IOPENR_GPIOBEN : RCC_IOPENR_GPIOCEN;
+        port->PUPDR &= ~(3u << bit);
+        port->MODER |= 3u << bit;
+    }
+};
+#else
+template <PinName pin>
+struct STM32ADCChannel {
+    static_assert(pin != pin, "no compile-time ADC pin map for this processor, use begin(pin)");
+};
+#endif
+
 class STM32ADC {
 
 public:
 
+    // BufferCallback is called from the DMA interrupt each time half of the DMA buffer has been
+    // filled, with a pointer to the filled half and its length in samples. It must consume the
+    // samples before the DMA wraps around and overwrites them.
+    typedef void (*BufferCallback)(uint16_t *samples, uint16_t count);
+
+    // Calibration holds an ADC calibration factor together with the ADC clock mode it was
+    // obtained with, and Vcc and temperature as recorded by checkCalibration, vcc is 0 until then.
+    struct Calibration {
+        uint8_t factor;
+        bool valid;
+        int16_t temp;
+        uint32_t vcc;
+        uint32_t clock;
+    };
+
+    // ConversionCallback is called from the ADC interrupt with the result of each conversion
+    // started using startConversion(callback).
+    typedef void (*ConversionCallback)(uint32_t value);
+
+    // Measurement holds the results of measure(): the pin voltage and Vcc in millivolts and the
+    // uC temperature in degrees centigrade.
+    struct Measurement {
+        uint32_t mV;
+        uint32_t vcc;
+        int16_t temp;
+    };
+
+    // State holds a snapshot of the ADC configuration taken by saveState: trigger, continuous
+    // mode, DMA, watchdog, oversampling, sampling time, channels, internal paths, interrupts and
+    // whether conversions were running.
+    struct State {
+        uint32_t cfgr1;
+        uint32_t cfgr2;
+        uint32_t smpr;
+        uint32_t chselr;
+        uint32_t ier;
+        uint32_t path;
+        bool running;
+    };
+
     // STM32ADC represents an Analog-to-Digital Converter device, which may have many channels
     // and therefore can convert from many input pins, but only one at a time. The constructor
     // does not initialize anything, use begin() for that purpose.
@@ -12,15 +88,29 @@ public:
     // STM32ADC objects for the same device since they would interfere with one-another.
     //
     // Typical usage is `STM32ADC(ADC1)`.
-    STM32ADC(ADC_TypeDef *adc) : _adc(adc) {};
+    STM32ADC(ADC_TypeDef *adc) : calibration(), calVccLimit(100), calTempLimit(10), irqCount(0),
+        _adc(adc), _dmaBuf(0), _dmaLen(0), _dmaCallback(0), _EOC_int(0), _EOCAL_int(0),
+        _AWD_int(0) {};
 
     // begin initializes the ADC device. It enables the clock, sets default conversion
     // parameters, configures software trigger, runs a calibration cycle (waiting for it to
-    // complete) and sets the mux to the specified pin.
+    // complete) and sets the mux to the specified pin. If a calibration for the same clock mode
+    // is cached (see calibration) it restores it instead of calibrating, without converting
+    // anything, drift in Vcc or temperature is left to checkCalibration.
     // It leaves the ADC enabled in auto-off mode (if available) and returns true if
     // the pin can be converted by this ADC. The ADC is enabled regardless of the return value.
     bool begin(uint8_t pin);
 
+    // begin<PB_1>() is like begin(pin) but resolves the channel at compile time, which reduces it
+    // to register writes and keeps the pinmap lookup out of the build unless other functions
+    // taking a pin are used. It also puts the pin into analog mode, so no pinMode(pin,
+    // INPUT_ANALOG) is needed, which would pull the lookup back in. It always returns true since
+    // other pins do not compile.
+    template <PinName pin> bool begin() {
+        STM32ADCChannel<pin>::analog();
+        return beginChannel(STM32ADCChannel<pin>::channel);
+    }
+
     // end shuts down the ADC device and is primarily useful to save power.
     void end();
 
@@ -28,6 +118,13 @@ public:
     // trigger or continuous mode configured.
     void startConversion();
 
+    // startConversion with a callback starts converting and returns immediately, the callback is
+    // invoked from the end-of-conversion interrupt with each result, i.e. once per channel in a
+    // scan, and repeatedly in continuous mode. This allows the caller to enter Sleep mode while
+    // the ADC converts. The interrupt is disabled at the end of the sequence unless continuous
+    // mode is selected.
+    void startConversion(ConversionCallback callback);
+
     // read waits for a conversion to complete and returns the result. Unless an external trigger or
     // continuous mode is configured startConversion() must be called first to initiate a
     // conversion.
@@ -39,87 +136,213 @@ public:
     // Advanced usage.
 
     // recalibrate performs an ADC calibration cycle and should only be called if Vcc or temperature
-    // conditions change significantly since the calibration done as part of begin().
-    // It busy-waits until the calibration completes.
+    // conditions change significantly since the calibration done as part of begin(), see
+    // checkCalibration. It stops conversions and busy-waits until the calibration completes.
     void recalibrate();
 
-#if 0
+    // checkCalibration takes a measurement the application made anyway, e.g. using measure(), and
+    // recalibrates if Vcc or the temperature moved by more than calVccLimit or calTempLimit since
+    // the calibration. The first measurement after a calibration records its conditions. It
+    // returns true if it recalibrated.
+    bool checkCalibration(const Measurement &m);
+
+    // startCalibration starts a calibration cycle and returns immediately, the callback, if any,
+    // is invoked from the end-of-calibration interrupt once the ADC is enabled again. The ADC
+    // must not be used until then, see calibrating().
+    void startCalibration(voidFuncPtr callback);
+
+    // calibrating returns true while a calibration started by startCalibration is in progress.
+    bool calibrating();
+
+    // calibration caches the last calibration, it survives end() and STOP mode, and can be saved,
+    // e.g., to EEPROM, and assigned before begin() after a reset. Calibrating takes ~80 ADC clock
+    // cycles plus the ADC power-up each time, restoring the factor is a register write. Set
+    // calibration.valid to false to force a calibration.
+    Calibration calibration;
+    uint16_t calVccLimit; // max change in Vcc in mV for the cached calibration, default 100
+    uint8_t calTempLimit; // max change in temperature in C for the cached calibration, default 10
+
+    // irqCount counts the ADC interrupts handled, i.e. the number of times the CPU was woken up
+    // by the ADC, which helps to compare the cost of different ways to use the ADC.
+    volatile uint32_t irqCount;
+
+    // updateClock re-selects the ADC clock after the system clock configuration changed, e.g.,
+    // after switching to a low-power clock profile that turns HSI16 off. It recalibrates unless
+    // the cached calibration was obtained with the new clock mode and is still valid.
+    void updateClock();
+
     // setSampleRate changes the sampling rate, the default is LL_ADC_SAMPLINGTIME_1CYCLE_5.
     // The set of possible sampling rates varies with uC type, see
     // system/Drivers/STM32L0xx_HAL_Driver/Inc/stm32l0xx_ll_adc.h or equivalent.
     // Note that sampleRate is a bit-field specific to the uC and not a true rate in Hz or such.
     void setSampleRate(uint32_t sampleRate);
 
-    // setPins configures the list of pins to convert. It configures a channel scan if more than one
-    // pin is provided. It returns true if all pins can be convereted by this ADC.
-    bool setPins(uint8_t *pins, uint8_t num);
-
-    // setChannels configures which channels to convert using a channel scan.
-    void setChannels(uint32_t channelBitmap);
-
     // setTrigger determines how the start of a conversion is triggered. The default is to trigger
     // explicitly by software, i.e., startConversion() / LL_ADC_REG_TRIG_SOFTWARE. Other options
-    // are to trigger by a timer or an external input, see stm32l0xx_ll_adc.h or equivalent.
+    // are to trigger by a timer or an external input, e.g. LL_ADC_REG_TRIG_EXT_TIM2_TRGO, see
+    // stm32l0xx_ll_adc.h or equivalent. A hardware trigger still requires startConversion() to
+    // arm the ADC. Note that begin() selects auto-off mode, which adds a power-up delay to each
+    // triggered conversion; at sample rates above ~100kHz it should be turned off using
+    // LL_ADC_SetLowPowerMode(ADC1, LL_ADC_LP_MODE_NONE).
     void setTrigger(uint32_t trigger);
 
-    // attachInterrupt attaches a callback function to the ADC completion interrupt.
-    void attachInterrupt(voidFuncPtr func, uint8 interrupt);
+    // setContinuous selects continuous conversions, where each conversion (or scan sequence)
+    // starts as soon as the previous one completes, or single conversions, where each one
+    // requires a trigger.
+    void setContinuous(bool continuous =true);
 
-    // startContinuous starts continuous ADC conversions.
-    void startContinuous();
+    // stop stops ongoing conversions, e.g., continuous or triggered ones, and waits for the ADC
+    // to be idle.
+    void stop();
+
+    // setOversampling configures the hardware oversampler, which accumulates ratio conversions
+    // (2..256, a power of two) and shifts the sum right by shift bits (0..8) to produce a single
+    // result, e.g., 256x with shift 4 produces 16-bit results. The result must fit into 16 bits.
+    // A ratio below 2 disables oversampling. If triggered is true each of the accumulated
+    // conversions needs its own trigger, else a single trigger runs all of them. Oversampling
+    // applies to each channel of a scan.
+    void setOversampling(uint16_t ratio, uint8_t shift, bool triggered =false);
+
+    // setPins configures the list of pins to convert. It configures a channel scan if more than one
+    // pin is provided. It returns true if all pins can be convereted by this ADC. Note that the
+    // STM32L0 always scans the channels in ascending channel number order.
+    bool setPins(const uint8_t *pins, uint8_t num);
+
+    // setChannels configures which channels to convert using a channel scan, channels is a bitmap
+    // with bit N set to convert channel N, LL_ADC_CHANNEL_x constants may be or-ed together. The
+    // internal channels (LL_ADC_CHANNEL_VREFINT and LL_ADC_CHANNEL_TEMPSENSOR) also need their
+    // path enabled, e.g., LL_ADC_SetCommonPathInternalCh.
+    void setChannels(uint32_t channels);
+
+    // readScan converts the configured channels once and uses DMA to store the results into
+    // values, in channel order. It returns the number of values stored, which is at most max, and
+    // may not be used while streaming using setDMA.
+    int readScan(uint16_t *values, int max);
+
+    // measure converts a pin, Vrefint and the temperature sensor in a single scan and returns
+    // the pin voltage, Vcc and the uC temperature. It saves and restores the ADC state (see
+    // saveState), and uses the longest sampling time for all three conversions, as required
+    // by the internal channels. The pin voltage is 0 if the pin cannot be converted.
+    // Oversample > 1 uses the hardware oversampler to average that many conversions per channel,
+    // see measureVcc.
+    Measurement measure(uint8_t pin, uint16_t oversample =1);
+
+    // measure<PB_1>() is like measure(pin) but resolves the channel at compile time.
+    template <PinName pin> Measurement measure(uint16_t oversample =1) {
+        return measureChannel(STM32ADCChannel<pin>::channel, oversample);
+    }
 
-    // stopContinuous stops continuous ADC conversions.
-    void resetContinuous();
-#endif
 
     // Internal sources.
 
     // measureVcc performs an internal measurement of Vcc in millivolts. It saves and restores the
-    // ADC state. Limitation: right now it requires the ADC to be in single conversion mode at the
-    // outset.
-    uint32_t measureVcc();
+    // ADC state, so it may be called while streaming, at the cost of a gap in the stream, see
+    // injectInternal for an alternative. Oversample > 1 (a power of two up to 256) uses the
+    // hardware oversampler to average that many conversions with a single CPU interaction, the
+    // result is computed with 16-bit precision, which reduces the noise of a single 12-bit
+    // conversion.
+    uint32_t measureVcc(uint16_t oversample =1);
 
     // measureTemp performs an internal temperature measurement in degrees centigrade.
-    // It saves and restores the ADC state. Limitation: right now it requires the ADC to be in
-    // single conversion mode at the outset.
-    int16_t measureTemp();
+    // It saves and restores the ADC state, see measureVcc. Oversample is as for measureVcc.
+    int16_t measureTemp(uint16_t oversample =1);
 
-    // DMA mode functions.
+    // saveState stops conversions and returns a snapshot of the ADC configuration, which
+    // restoreState puts back, restarting conversions if they were running. In between the ADC
+    // may be reconfigured at will, except for the DMA channel, which keeps its position such
+    // that a circular DMA stream resumes where it left off. A multi-channel stream is stopped
+    // at the end of a scan, as the restart begins with the first channel, which requires a
+    // buffer length that is a multiple of the scan length. With a trigger the ADC is idle
+    // between scans, but in continuous mode the next scan starts right away and its first
+    // conversion may complete before the stop takes effect, so only stream multiple channels
+    // with a trigger when measuring in between.
+    State saveState();
+    void restoreState(const State &state);
 
-#if 0
-    // setDMA configures DMA with the ADC. It is independent of whether continuous mode or scan mode
-    // are used. The callback() function is invoked when the DMA completes.
-    void setDMA(uint16_t *buf, uint16_t bufLen, uint32_t dmaFlags, voidFuncPtr callback);
+    // injectInternal adds Vrefint and the temperature sensor to the configured channels, or
+    // removes them, such that each scan of a stream ends with two internal slots, which monitors
+    // Vcc and temperature without gaps in the sampled signal. It stops conversions, like
+    // setChannels, so it is best called before starting the stream. All channels share the
+    // sampling time, which must be long enough for the internal channels (~10us), see
+    // setSampleRate.
+    void injectInternal(bool enable =true);
 
-    // setDMA configures DMA with dual ADC. It is independent of whether continuous mode or scan mode
-    // are used. It assumes that the uC has two devices.
-    void setDualDMA(uint32_t *buf, uint16_t bufLen, uint32_t dmaFlags);
+    // scanLength returns the number of conversions in a scan of the configured channels.
+    int scanLength();
 
-    // setScanMode enables scan mode use with DMA.
-    void setScanMode();
+    // internal decodes the internal slots of a complete scan in a stream set up using
+    // injectInternal, i.e. scan points to the first of scanLength() values, and returns Vcc and
+    // the uC temperature, taking oversampling into account. The mV field is 0.
+    Measurement internal(const uint16_t *scan);
 
-    // attachDMAInterrupt attaches a callback function to the completion of a DMA operation.
-    void attachDMAInterrupt(voidFuncPtr func);
+    // DMA mode functions.
+
+    // setDMA configures DMA channel 1 to transfer conversion results into buf, which is used as
+    // a circular buffer of bufLen samples. The callback is invoked from the DMA interrupt each
+    // time half the buffer has been filled, which means the other half is being filled
+    // concurrently. It is independent of whether continuous mode or scan mode are used, and is
+    // typically combined with a timer trigger to sample at a fixed rate without any CPU
+    // involvement per sample. bufLen must be even. Only one ADC can use DMA at a time.
+    void setDMA(uint16_t *buf, uint16_t bufLen, BufferCallback callback);
+
+    // stopDMA stops conversions and disables the DMA.
+    void stopDMA();
 
     // Watchdog functions.
+    //
+    // The analog watchdog compares each conversion result against a high and a low threshold
+    // in hardware and can raise an interrupt when a result falls outside. Combined with a
+    // low-rate timer trigger this monitors a voltage without waking the CPU for each sample.
+    // The ADC needs its clock so this works in Sleep and Low-power sleep modes, not in STOP.
+
+    // setAnalogWatchdog configures and enables the analog watchdog on a channel that is being
+    // converted, or on all converted channels if channel is -1. The limits are raw conversion
+    // results, i.e., after oversampling, if enabled. The watchdog fires when a result is above
+    // highLimit or below lowLimit. It stops conversions since the configuration can only be
+    // changed while the ADC is idle.
+    void setAnalogWatchdog(int8_t channel, uint32_t highLimit, uint32_t lowLimit);
 
-    // startAnalogWatchdog configures and enables the analog watchdog on a channel that is being
-    // converted.
-    void setAnalogWatchdog(uint8_t channel, uint32_t highLimit, uint32_t lowLimit);
+    // clearAnalogWatchdog disables the analog watchdog.
+    void clearAnalogWatchdog();
 
     // checkAnalogWatchdog polls the status of the watchdog returning true if the watchdog fired.
     // It also resets the watchdog status.
     bool checkAnalogWatchdog();
 
     // attachAnalogWatchdogInterrupt attaches a callback function with the analog watchdog
-    // interrupt.
+    // interrupt, or detaches it if func is NULL. The callback runs in interrupt context each time
+    // a conversion falls outside the limits, it may, e.g., call clearAnalogWatchdog or stop.
     void attachAnalogWatchdogInterrupt(voidFuncPtr func);
-#endif
+
+    // dmaIRQ handles the DMA half and full transfer interrupts, it is called by the interrupt
+    // handler and does not need to be called by the application.
+    void dmaIRQ();
+
+    // irq handles the ADC interrupts, it is called by the interrupt handler and does not need to
+    // be called by the application.
+    void irq();
 
 private:
+    int pinChannel(uint8_t pin);
+    bool beginChannel(int chan);
+    Measurement measureChannel(int chan, uint16_t oversample);
+    void calibrate();
+    void restoreCalibration();
+    uint32_t getOversampling();
+    void putOversampling(uint32_t cfgr2);
+    uint8_t oversampleFor16(uint16_t oversample);
+    int pollScan(uint16_t *values, int max);
+    void selectClock();
+    void stopConversion();
+
     ADC_TypeDef *_adc;
-    //voidFuncPtr _DMA_int;
-    //voidFuncPtr _ADC_int;
-    //voidFuncPtr _AWD_int;
+    uint16_t *_dmaBuf;
+    uint16_t _dmaLen;
+    BufferCallback _dmaCallback;
+    ConversionCallback _EOC_int;
+    voidFuncPtr _EOCAL_int;
+    voidFuncPtr _AWD_int;
 
 };
+
+#endif
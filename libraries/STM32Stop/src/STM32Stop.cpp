@@ -0,0 +1,208 @@
+// STOP mode sleep with LPTIM wake-up for the STM32L0, see STM32Stop.h
+#include "STM32Stop.h"
+
+#define REG(a) (*(volatile uint32_t*)(a))
+
+static constexpr uint32_t RCC_CFGR    = 0x4002100C;
+static constexpr uint32_t RCC_APB1ENR = 0x40021038;
+static constexpr uint32_t RCC_IOPENR  = 0x4002102C;
+static constexpr uint32_t RCC_APB2ENR = 0x40021034;
+static constexpr uint32_t RCC_CCIPR   = 0x4002104C;
+static constexpr uint32_t RCC_CSR     = 0x40021050;
+static constexpr uint32_t PWR_CR      = 0x40007000;
+static constexpr uint32_t SYSCFG_EXTICR = 0x40010008;
+static constexpr uint32_t EXTI_IMR    = 0x40010400;
+static constexpr uint32_t EXTI_EMR    = 0x40010404;
+static constexpr uint32_t EXTI_RTSR   = 0x40010408;
+static constexpr uint32_t EXTI_FTSR   = 0x4001040C;
+static constexpr uint32_t EXTI_PR     = 0x40010414;
+static constexpr uint32_t GPIO_BASE   = 0x50000000; // port A, 0x400 per port
+static constexpr uint32_t GPIO_MODER  = 0x00;
+static constexpr uint32_t GPIO_PUPDR  = 0x0C;
+static constexpr uint32_t GPIO_IDR    = 0x10;
+static constexpr uint32_t LPTIM_ISR   = 0x40007C00;
+static constexpr uint32_t LPTIM_ICR   = 0x40007C04;
+static constexpr uint32_t LPTIM_IER   = 0x40007C08;
+static constexpr uint32_t LPTIM_CFGR  = 0x40007C0C;
+static constexpr uint32_t LPTIM_CR    = 0x40007C10;
+static constexpr uint32_t LPTIM_CMP   = 0x40007C14;
+static constexpr uint32_t LPTIM_ARR   = 0x40007C18;
+static constexpr uint32_t LPTIM_CNT   = 0x40007C1C;
+static constexpr uint32_t SYST_CSR    = 0xE000E010;
+static constexpr uint32_t SCB_SCR     = 0xE000ED10;
+static constexpr uint32_t NVIC_ICPR   = 0xE000E280;
+static constexpr int LPTIM1_IRQn      = 13;
+static constexpr int LPTIM1_EXTI      = 29;
+
+// readCnt reads the LPTIM counter, which runs asynchronously and must be read until two
+// consecutive reads match.
+static uint16_t readCnt() {
+    uint32_t c;
+    do c = REG(LPTIM_CNT); while (c != REG(LPTIM_CNT));
+    return c;
+}
+
+void STM32Stop::begin(bool lse) {
+    REG(RCC_APB1ENR) |= (1u<<31) | (1<<28); // LPTIM1EN, PWREN
+    uint32_t sel;
+    if (lse) {
+        REG(PWR_CR) |= 1<<8; // DBP: allow access to RCC_CSR LSE bits
+        REG(RCC_CSR) |= 1<<8; // LSEON
+        while ((REG(RCC_CSR) & (1<<9)) == 0) ; // LSERDY
+        sel = 3;
+        hz = 32768;
+    } else {
+        REG(RCC_CSR) |= 1<<0; // LSION
+        while ((REG(RCC_CSR) & (1<<1)) == 0) ; // LSIRDY
+        sel = 1;
+        hz = 37000;
+    }
+    REG(RCC_CCIPR) = (REG(RCC_CCIPR) & ~(3<<18)) | (sel<<18); // LPTIM1SEL
+    REG(EXTI_IMR) |= 1<<LPTIM1_EXTI; // LPTIM1 wake-up from STOP
+}
+
+void STM32Stop::calibrate(uint32_t (*msClock)()) {
+    REG(LPTIM_CR) = 0;
+    REG(LPTIM_CFGR) = 0; // no prescaler
+    REG(LPTIM_CR) = 1; // ENABLE
+    REG(LPTIM_ARR) = 0xFFFF;
+    REG(LPTIM_CR) |= 1<<2; // CNTSTRT
+    uint32_t t0 = msClock();
+    while (msClock() == t0) ;
+    uint16_t c0 = readCnt();
+    // count LPTIM ticks (wrapping at 16 bits) during 100ms
+    uint32_t ticks = 0;
+    uint16_t c = c0;
+    while (msClock() - t0 <= 100) {
+        uint16_t n = readCnt();
+        ticks += (uint16_t)(n - c);
+        c = n;
+    }
+    REG(LPTIM_CR) = 0;
+    hz = ticks * 10;
+}
+
+void STM32Stop::wakeOnPin(char port, uint8_t pin, bool activeHigh) {
+    if (pinPort != 0) { // disable the previous wake-up pin
+        REG(EXTI_EMR) &= ~(1<<pinNum);
+        REG(EXTI_RTSR) &= ~(1<<pinNum);
+        REG(EXTI_FTSR) &= ~(1<<pinNum);
+        pinPort = 0;
+    }
+    if (port < 'A' || port > 'C' || pin > 15) return;
+    uint32_t idx = port - 'A';
+    pinPort = GPIO_BASE + 0x400 * idx;
+    pinNum = pin;
+    pinHigh = activeHigh;
+
+    REG(RCC_IOPENR) |= 1<<idx;
+    REG(RCC_APB2ENR) |= 1<<0; // SYSCFGEN
+    REG(pinPort+GPIO_MODER) &= ~(3<<(2*pin)); // input
+    REG(pinPort+GPIO_PUPDR) = (REG(pinPort+GPIO_PUPDR) & ~(3<<(2*pin)))
+            | ((activeHigh ? 2 : 1) << (2*pin)); // pull-down or pull-up
+    uint32_t exticr = SYSCFG_EXTICR + 4 * (pin / 4);
+    REG(exticr) = (REG(exticr) & ~(0xF<<(4*(pin%4)))) | (idx<<(4*(pin%4)));
+    if (activeHigh)
+        REG(EXTI_RTSR) |= 1<<pin;
+    else
+        REG(EXTI_FTSR) |= 1<<pin;
+    REG(EXTI_EMR) |= 1<<pin; // event only, no interrupt handler needed
+}
+
+bool STM32Stop::pinActive() const {
+    if (pinPort == 0) return false;
+    bool high = (REG(pinPort+GPIO_IDR) & (1<<pinNum)) != 0;
+    return high == pinHigh;
+}
+
+// sleepTicks enters STOP mode until LPTIM1 has counted the requested number of ticks with the
+// given prescaler (LPTIM_CFGR.PRESC, divides by 1<<presc). The wake-up uses WFE with SEVONPEND so
+// no LPTIM interrupt handler is needed. It returns the number of ticks slept, which is less than
+// requested if the wake-up pin became active.
+uint32_t STM32Stop::sleepTicks(uint8_t presc, uint16_t ticks) {
+    REG(LPTIM_CR) = 0;
+    REG(LPTIM_CFGR) = (presc & 7) << 9;
+    REG(LPTIM_IER) = 1<<0; // CMPMIE
+    REG(LPTIM_CR) = 1; // ENABLE
+    REG(LPTIM_ICR) = 0x7F;
+    REG(LPTIM_ARR) = 0xFFFF;
+    while ((REG(LPTIM_ISR) & (1<<4)) == 0) ; // ARROK
+    REG(LPTIM_CMP) = ticks;
+    while ((REG(LPTIM_ISR) & (1<<3)) == 0) ; // CMPOK
+    REG(LPTIM_ICR) = 0x7F;
+    REG(LPTIM_CR) |= 1<<2; // CNTSTRT
+
+    // SysTick does not run in STOP mode but an interrupt pending on entry would wake us up
+    uint32_t systick = REG(SYST_CSR);
+    REG(SYST_CSR) = systick & ~(1<<1); // TICKINT off
+
+    // STOP with low-power regulator, Vrefint off, fast wake-up, clear wake-up flag
+    REG(PWR_CR) = (REG(PWR_CR) & ~(1<<1)) | (1<<0) | (1<<2) | (1<<9) | (1<<10);
+    // wake up on HSI16 unless running on MSI
+    if ((REG(RCC_CFGR) & (3<<2)) == 0)
+        REG(RCC_CFGR) &= ~(1<<15);
+    else
+        REG(RCC_CFGR) |= 1<<15; // STOPWUCK
+    REG(SCB_SCR) |= (1<<2) | (1<<4); // SLEEPDEEP, SEVONPEND
+
+    __asm volatile ("sev; wfe"); // clear the event register
+    while ((REG(LPTIM_ISR) & (1<<0)) == 0 && !pinActive()) // CMPM
+        __asm volatile ("wfe");
+    uint16_t woke = readCnt();
+    pinWoke = (REG(LPTIM_ISR) & (1<<0)) == 0;
+
+    REG(SCB_SCR) &= ~(1<<2);
+    if (restoreClock) restoreClock();
+    uint16_t restored = readCnt();
+
+    REG(LPTIM_ICR) = 0x7F;
+    REG(NVIC_ICPR) = 1<<LPTIM1_IRQn;
+    REG(LPTIM_CR) = 0;
+    REG(SYST_CSR) = systick;
+
+    if (pinWoke) {
+        if (pinPort != 0) REG(EXTI_PR) = 1<<pinNum;
+        return woke < ticks ? woke : ticks;
+    }
+    lastLatency = woke - ticks;
+    lastRestore = restored - ticks;
+    return ticks;
+}
+
+uint32_t STM32Stop::stop(uint32_t ms) {
+    uint32_t slept = 0;
+    pinWoke = false;
+    while (ms > 0 && !pinWoke) {
+        // pick the smallest prescaler that fits the remaining time into 16 bits, or sleep as
+        // long as possible with the largest prescaler and loop
+        uint8_t presc = 0;
+        uint32_t ticks = (uint64_t)ms * hz / 1000;
+        while (ticks > 0xFF00 && presc < 7) {
+            presc++;
+            ticks >>= 1;
+        }
+        if (ticks > 0xFF00) ticks = 0xFF00;
+        if (ticks == 0) break;
+        uint32_t t = (uint64_t)sleepTicks(presc, ticks) * (1000 << presc) / hz;
+        if (t == 0 && !pinWoke) break;
+        slept += t;
+        ms = t < ms ? ms - t : 0;
+    }
+    return slept;
+}
+
+void STM32Stop::measureLatency() {
+    sleepTicks(0, hz / 100); // 10ms, full resolution
+    wakeUs = (uint32_t)lastLatency * 1000000 / hz;
+    restoreUs = (uint32_t)lastRestore * 1000000 / hz;
+}
+
+uint32_t STM32Stop::avgCurrent(uint32_t intervalMs, uint32_t awakeMs, uint32_t awakeUA,
+        uint32_t extraNAh, uint32_t stopUA) {
+    if (intervalMs == 0) return 0;
+    uint32_t stopMs = intervalMs > awakeMs ? intervalMs - awakeMs : 0;
+    // 1uA for 1ms is 1/3600nAh, accumulate in pAh
+    uint64_t pAh = ((uint64_t)awakeUA * awakeMs + (uint64_t)stopUA * stopMs) * 1000 / 3600
+            + (uint64_t)extraNAh * 1000;
+    return pAh * 3600 / intervalMs; // pAh * 3.6e6 / ms / 1000 -> nA
+}
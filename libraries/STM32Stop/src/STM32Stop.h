@@ -0,0 +1,71 @@
+// STOP mode sleep with LPTIM wake-up for the STM32L0
+//
+// The STM32Stop puts the uC into STOP mode, where all clocks except LSI/LSE are off, and uses
+// LPTIM1 to wake it up after a given number of milliseconds. It works with plain register
+// accesses so it can be used with the Arduino framework as well as with JeeH.
+//
+// SysTick does not run in STOP mode, so the caller needs to advance its millisecond counter by
+// the value returned from stop(). If the system clock runs off the PLL it also needs to provide a
+// restoreClock function, e.g. SystemClock_Config, because the uC always wakes up on HSI16 (or
+// MSI, if that's what it was running on).
+#ifndef _STM32STOP_
+#define _STM32STOP_
+
+#include <stdint.h>
+
+class STM32Stop {
+
+public:
+
+    // begin enables LPTIM1 on the LSI (default) or on the LSE 32768Hz crystal and waits for the
+    // oscillator to be ready. The LSI is nominally 37kHz but varies widely between parts, use
+    // calibrate() to measure it.
+    void begin(bool lse =false);
+
+    // calibrate measures the LSI frequency over 100ms using a millisecond clock function, e.g.
+    // millis() or a function returning JeeH's ticks.
+    void calibrate(uint32_t (*msClock)());
+
+    // stop puts the uC into STOP mode for the specified number of milliseconds and returns the
+    // number of milliseconds actually slept, which may be a tad less due to rounding.
+    uint32_t stop(uint32_t ms);
+
+    // wakeOnPin makes stop() also return early when the given pin (port 'A'..'C', pin 0..15)
+    // becomes active, e.g. the ALERT output of a sensor. The pin is set up as input with a pull-up
+    // (or pull-down if active high) and an EXTI wake-up event on its active edge. If the pin is
+    // already active, stop() returns right away. Use wakeOnPin(0, 0) to disable.
+    void wakeOnPin(char port, uint8_t pin, bool activeHigh =false);
+
+    // pinActive returns true if the wake-up pin is currently in its active state.
+    bool pinActive() const;
+
+    // measureLatency performs a short STOP and measures the time from the LPTIM wake-up event
+    // to the first instruction executed (in wakeUs) and to having restored the clock (restoreUs).
+    // The resolution is one LPTIM tick, i.e., approx 27us on the LSI.
+    void measureLatency();
+
+    // avgCurrent estimates the average current in nA drawn over a reporting interval given the
+    // time and current while awake, any extra charge drawn (e.g. by the radio, see
+    // SX1231Energy) and the current while in STOP, which includes the attached devices.
+    static uint32_t avgCurrent(uint32_t intervalMs, uint32_t awakeMs, uint32_t awakeUA,
+            uint32_t extraNAh, uint32_t stopUA);
+
+    // restoreClock, if set, is called immediately after waking up to restore the system clock.
+    void (*restoreClock)() =0;
+
+    bool pinWoke =false; // set by stop() when it returned early due to the wake-up pin
+
+    uint32_t hz;        // LPTIM clock frequency
+    uint32_t wakeUs;    // wake-up to first instruction latency measured by measureLatency()
+    uint32_t restoreUs; // wake-up to clock restored latency measured by measureLatency()
+
+private:
+    uint32_t sleepTicks(uint8_t presc, uint16_t ticks);
+    uint16_t lastLatency; // LPTIM ticks from wake-up event to first instruction in sleepTicks
+    uint16_t lastRestore; // LPTIM ticks from wake-up event to restored clock in sleepTicks
+    uint32_t pinPort =0;  // GPIO base address of the wake-up pin, 0 if none
+    uint8_t pinNum;
+    bool pinHigh;
+};
+
+#endif
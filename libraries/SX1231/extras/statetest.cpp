@@ -0,0 +1,145 @@
+// Host test for the SX1231 state persistence. It runs the driver against a RAM register file and
+// the SX1231EepromRam emulation and checks that the state survives a "reset", that the ring of
+// slots is used round-robin, that a torn write falls back to the previous record, and that only
+// ACK packets count towards nAck.
+//
+// Build and run on Linux from this directory:
+//   g++ -O2 -I../src statetest.cpp ../src/SX1231.cpp -o statetest && ./statetest
+#include <stdio.h>
+#include <string.h>
+#include "SX1231.h"
+
+// FakeRegs is a register file that reads back what was written, plus a canned FIFO packet.
+struct FakeRegs : SX1231Regs {
+    FakeRegs() : pkt(0), pktLen(0) { memset(regs, 0, sizeof(regs)); }
+
+    uint8_t readReg (uint8_t addr) const { return regs[addr & 0x7F]; }
+    void writeReg (uint8_t addr, uint8_t val) const { regs[addr & 0x7F] = val; }
+    int readPacket (void* ptr, int len) const {
+        memcpy(ptr, pkt, pktLen < len ? pktLen : len);
+        return pktLen;
+    }
+    void writePacket (uint8_t /*hdr1*/, uint8_t /*hdr2*/, const void* /*ptr*/, int /*len*/) const {}
+
+    mutable uint8_t regs[128];
+    const uint8_t* pkt;
+    int pktLen;
+};
+
+static int fails;
+
+#define CHECK(cond) do { if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+    fails++; } } while (0)
+
+static const int eeWords = SX1231State::base + SX1231State::nSlots * SX1231State::nWords;
+typedef SX1231EepromRam<eeWords> Eeprom;
+
+// slotWear returns the number of writes to the checksum word of a ring slot.
+static uint32_t slotWear (const Eeprom& ee, int slot) {
+    return ee.wear[SX1231State::base + slot*SX1231State::nWords + SX1231State::nWords-1];
+}
+
+int main() {
+    Eeprom ee;
+    FakeRegs regs;
+
+    { // fresh EEPROM: nothing to restore, first forced save goes to slot 0
+        SX1231 rf(regs, &ee);
+        CHECK(rf.init(61, 6, 868));
+        CHECK(rf._slot == -1);
+        CHECK(rf.nTx == 0 && rf.nAck == 0);
+        CHECK(!rf.loadState());
+        rf.setFreq(rf.nomFreq + 4000);
+        rf.txPower(5);
+        rf.nTx = 10;
+        rf.nAck = 9;
+        CHECK(rf.saveState());
+        CHECK(rf._slot == 0);
+        CHECK(slotWear(ee, 0) == 1);
+        CHECK(!rf.saveState()); // nothing changed materially
+        rf.setFreq(rf.actFreq + 500);
+        CHECK(!rf.saveState()); // moved by less than 1kHz
+        CHECK(rf.saveState(true));
+        CHECK(rf._slot == 1);
+    }
+
+    { // reset: the state comes back from the newest slot
+        SX1231 rf(regs, &ee);
+        CHECK(rf.init(61, 6, 868));
+        CHECK(rf._slot == 1);
+        CHECK((int32_t)(rf.actFreq - rf.nomFreq) == 4500);
+        CHECK(rf.txpow == 5);
+        CHECK(rf.nTx == 10 && rf.nAck == 9);
+
+        // round-robin: 8 slots, so 16 more saves hit every slot twice more
+        for (int i=0; i<16; i++) {
+            rf.nTx += 64;
+            CHECK(rf.saveState());
+        }
+        CHECK(rf._slot == 1);
+        for (int s=0; s<SX1231State::nSlots; s++)
+            CHECK(slotWear(ee, s) == (s <= 1 ? 3u : 2u));
+    }
+
+    { // torn write: a bad checksum in the newest slot falls back to the previous record
+        ee.mem[SX1231State::base + 1*SX1231State::nWords + SX1231State::nWords-1] ^= 1;
+        SX1231 rf(regs, &ee);
+        CHECK(rf.init(61, 6, 868));
+        CHECK(rf._slot == 0);
+        CHECK(rf.nTx == 10 + 15*64);
+    }
+
+    { // only ACKs count towards nAck
+        SX1231 rf(regs, &ee);
+        CHECK(rf.init(61, 6, 868));
+        rf.fei = 0;
+        uint16_t nAck = rf.nAck;
+        uint8_t buf[8];
+        uint8_t dest = rf._parity | rf.myId;
+
+        const uint8_t notAck[] = { dest, 0x81, 0x12, 0x34 };
+        regs.pkt = notAck;
+        regs.pktLen = sizeof(notAck);
+        CHECK(rf.readAck(buf, sizeof(buf)) == 0);
+        CHECK(rf.nAck == nAck);
+
+        const uint8_t otherNode[] = { (uint8_t)(rf._parity | 12), 0x01 };
+        regs.pkt = otherNode;
+        regs.pktLen = sizeof(otherNode);
+        CHECK(rf.readAck(buf, sizeof(buf)) == 0);
+        CHECK(rf.nAck == nAck);
+
+        const uint8_t oldAck[] = { dest, 0x01 };
+        regs.pkt = oldAck;
+        regs.pktLen = sizeof(oldAck);
+        CHECK(rf.readAck(buf, sizeof(buf)) == 2);
+        CHECK(rf.nAck == nAck+1);
+
+        const uint8_t ack[] = { dest, 0x01, 0x00, 0x00 };
+        regs.pkt = ack;
+        regs.pktLen = sizeof(ack);
+        CHECK(rf.readAck(buf, sizeof(buf)) == 4);
+        CHECK(rf.nAck == nAck+2);
+    }
+
+    { // temperature compensation table round-trips and only changed words are rewritten
+        SX1231 rf(regs, &ee);
+        CHECK(rf.init(61, 6, 868));
+        rf.tc.learn(20, -1200);
+        rf.tc.learn(40, 800);
+        rf.saveTempComp();
+        uint32_t w = ee.wear[1];
+        rf.saveTempComp();
+        CHECK(ee.wear[1] == w);
+
+        SX1231 rf2(regs, &ee);
+        CHECK(rf2.init(61, 6, 868));
+        int32_t hz;
+        CHECK(rf2.tc.lookup(20, hz) && hz == -1200);
+        CHECK(rf2.tc.lookup(40, hz) && hz == 800);
+        CHECK(rf2.tc.lookup(30, hz) && hz == -1200 + 2000 * 2 / 5);
+    }
+
+    printf("%s\n", fails ? "FAILED" : "ok");
+    return fails ? 1 : 0;
+}
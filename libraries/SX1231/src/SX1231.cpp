@@ -32,16 +32,47 @@
 #elif ARDUINO
 #include <Arduino.h>
 #include <SPI.h>
+#else
+#include <stdio.h> // host-side tests
 #endif
 #include "SX1231.h"
 
 // setMode switches the radio to a different operating mode. Note that this is not immediate and
 // setMode does not wait for the switch to complete.
 void SX1231::setMode (uint8_t newMode) {
+    account();
     _mode = newMode;
     _regs.writeReg(REG_OPMODE, (newMode&0x7)<<2);
 }
 
+// dBmToUW maps the PA0 output power from -18dBm to 13dBm to microwatts.
+static const uint16_t dBmToUW[] = {
+    16, 20, 25, 32, 40, 50, 63, 79, 100, 126, 158, 200, 251, 316, 398, 501, 631, 794,
+    1000, 1259, 1585, 1995, 2512, 3162, 3981, 5012, 6310, 7943, 10000, 12589, 15849, 19953,
+};
+
+// setClock enables the airtime and energy accounting. The clock function must return a
+// free-running time in microseconds, the counters in energy start from zero.
+void SX1231::setClock (uint32_t (*usClock)()) {
+    _clock = usClock;
+    _modeStart = _clock ? _clock() : 0;
+    energy.reset();
+}
+
+// account adds the time spent in the current mode since the last mode change, and the
+// corresponding charge, to the energy counters. It is called just before any mode change.
+void SX1231::account () {
+    if (!_clock) return;
+    uint32_t now = _clock();
+    uint32_t dt = now - _modeStart;
+    _modeStart = now;
+    uint8_t m = _mode <= MODE_RECEIVE ? _mode : (uint8_t)MODE_SLEEP;
+    uint32_t ua = energy.modeUA[m];
+    if (m == MODE_TRANSMIT) ua += (uint32_t)energy.txUAperMW * dBmToUW[txpow+18] / 1000;
+    energy.modeUs[m] += dt;
+    energy.charge += (uint64_t)ua * dt;
+}
+
 void SX1231::setFreq (uint32_t hz) {
     // accept any frequency scale as input, including KHz and MHz
     // multiply by 10 until freq >= 100 MHz (don't specify 0 as input!)
@@ -75,6 +106,7 @@ void SX1231::configure (const uint8_t* p) {
         _regs.writeReg(cmd, p[1]);
         p += 2;
     }
+    account();
     _mode = MODE_SLEEP;
 }
 
@@ -134,6 +166,18 @@ bool SX1231::init (uint8_t id, uint8_t group, int freq) {
 
     configure(SX1231configRegs);
     setFreq(freq);
+    nomFreq = actFreq;
+    txPower(13); // chip default
+    tcTemp = 25;
+    tc.valid = 0;
+    tcDirty = 0;
+    _tcBucket = -1;
+    nTx = nAck = 0;
+    _slot = -1;
+    if (_ee) {
+        loadTempComp();
+        loadState();
+    }
 
     _regs.writeReg(REG_SYNCVALUE3, group);
     return true;
@@ -190,6 +234,137 @@ void SX1231::adjustFreq() {
     setFreq(actFreq-corr); // apply correction
 }
 
+// lookup returns the correction for the given temperature. If the temperature's bucket has not
+// been learned it interpolates between the nearest learned buckets, or extends the nearest one
+// if there are only learned buckets on one side. It returns false if nothing has been learned.
+bool SX1231TempComp::lookup (int16_t degC, int32_t &hz) const {
+    int b = bucket(degC);
+    if (valid & (1UL<<b)) { hz = corr[b]; return true; }
+    int lo = b-1, hi = b+1;
+    while (lo >= 0 && !(valid & (1UL<<lo))) lo--;
+    while (hi < nBuckets && !(valid & (1UL<<hi))) hi++;
+    if (lo < 0 && hi >= nBuckets) return false;
+    if (lo < 0) { hz = corr[hi]; return true; }
+    if (hi >= nBuckets) { hz = corr[lo]; return true; }
+    hz = corr[lo] + (int32_t)(corr[hi]-corr[lo]) * (b-lo) / (hi-lo);
+    return true;
+}
+
+// learn records the correction that was found to be right at the given temperature. The first
+// sample in a bucket is taken as-is, subsequent ones are averaged in with a weight of 1/4.
+void SX1231TempComp::learn (int16_t degC, int32_t hz) {
+    if (hz > 32767) hz = 32767;
+    if (hz < -32768) hz = -32768;
+    int b = bucket(degC);
+    if (valid & (1UL<<b)) {
+        corr[b] += (hz - corr[b]) / 4;
+    } else {
+        corr[b] = hz;
+        valid |= 1UL<<b;
+    }
+}
+
+// tempComp records the current temperature and, if it falls into a different bucket than the one
+// used for the previous transmission, pre-corrects the frequency using the learned table. Within
+// the same bucket the frequency continues to track the FEI-based adjustFreq corrections.
+void SX1231::tempComp (int16_t degC) {
+    tcTemp = degC;
+    int b = SX1231TempComp::bucket(degC);
+    if (b == _tcBucket) return;
+    int32_t hz;
+    if (!tc.lookup(degC, hz)) return;
+    _tcBucket = b;
+    setFreq(nomFreq + hz);
+}
+
+// loadTempComp restores the temperature compensation table from EEPROM and returns true if the
+// stored table was valid. It is called by init().
+bool SX1231::loadTempComp () {
+    if (!_ee || _ee->read(0) != SX1231TempComp::magic) return false;
+    uint32_t* p = (uint32_t*)&tc;
+    for (unsigned i=0; i<sizeof(tc)/4; i++)
+        p[i] = _ee->read(1+i);
+    _tcBucket = -1;
+    tcDirty = 0;
+    return true;
+}
+
+// saveTempComp persists the temperature compensation table to EEPROM. Only words that changed are
+// written to conserve EEPROM write cycles. The application decides when to save based on tcDirty.
+void SX1231::saveTempComp () {
+    if (!_ee) return;
+    const uint32_t* p = (const uint32_t*)&tc;
+    for (unsigned i=0; i<sizeof(tc)/4; i++)
+        if (_ee->read(1+i) != p[i]) _ee->write(1+i, p[i]);
+    if (_ee->read(0) != SX1231TempComp::magic) _ee->write(0, SX1231TempComp::magic);
+    tcDirty = 0;
+}
+
+// checksum calculates a rotate-xor checksum over the record, excluding the sum itself. The seed
+// ensures that an erased (all-zero) slot does not look valid.
+uint32_t SX1231State::checksum () const {
+    const uint32_t* p = (const uint32_t*)this;
+    uint32_t sum = 0x5AA5C33C;
+    for (int i=0; i<nWords-1; i++)
+        sum = ((sum << 5) | (sum >> 27)) ^ p[i];
+    return sum;
+}
+
+// loadState scans the EEPROM ring for the valid record with the highest sequence number and
+// restores the frequency correction, tx power and link stats from it. It is called by init().
+bool SX1231::loadState () {
+    if (!_ee) return false;
+    SX1231State st;
+    uint32_t* p = (uint32_t*)&st;
+    for (int s=0; s<SX1231State::nSlots; s++) {
+        for (int i=0; i<SX1231State::nWords; i++)
+            p[i] = _ee->read(SX1231State::base + s*SX1231State::nWords + i);
+        if (st.sum != st.checksum()) continue;
+        if (_slot >= 0 && (int32_t)(st.seq - _saved.seq) <= 0) continue;
+        _saved = st;
+        _slot = s;
+    }
+    if (_slot < 0) return false;
+    // don't trust a correction that is way outside of what adjustFreq would produce
+    if (_saved.freqCorr < 100000 && _saved.freqCorr > -100000)
+        setFreq(nomFreq + _saved.freqCorr);
+    txPower(_saved.txpow);
+    margin = _saved.margin;
+    rssi = _saved.rssi;
+    nTx = _saved.nTx;
+    nAck = _saved.nAck;
+    return true;
+}
+
+// saveState persists the frequency correction, tx power and link stats to the next slot in the
+// EEPROM ring. To conserve write cycles it only does so if the frequency moved by more than 1kHz,
+// the tx power changed, or 64 packets were sent since the last save, unless force is set.
+bool SX1231::saveState (bool force) {
+    if (!_ee) return false;
+    int32_t corr = (int32_t)(actFreq - nomFreq);
+    if (!force && _slot >= 0) {
+        int32_t df = corr - _saved.freqCorr;
+        if (df < 1000 && df > -1000 && txpow == _saved.txpow && (uint16_t)(nTx - _saved.nTx) < 64)
+            return false;
+    }
+    SX1231State st;
+    st.seq = _slot >= 0 ? _saved.seq + 1 : 1;
+    st.freqCorr = corr;
+    st.txpow = txpow;
+    st.margin = margin;
+    st.rssi = rssi;
+    st.nTx = nTx;
+    st.nAck = nAck;
+    st.sum = st.checksum();
+    int slot = (_slot + 1) % SX1231State::nSlots;
+    const uint32_t* p = (const uint32_t*)&st;
+    for (int i=0; i<SX1231State::nWords; i++) // sum is last so a torn write leaves an invalid slot
+        _ee->write(SX1231State::base + slot*SX1231State::nWords + i, p[i]);
+    _saved = st;
+    _slot = slot;
+    return true;
+}
+
 // sleep puts the sx1231 into the lowest power sleep mode.
 void SX1231::sleep () {
     setMode(MODE_SLEEP);
@@ -263,10 +438,17 @@ int SX1231::readAck(void* ptr, int len) {
     uint8_t *buf = (uint8_t*)ptr; // get a pointer we can dereference
     if ((buf[0] & 0xC0)!= _parity) return 0; // bad group parity
     if ((buf[0] & 0x3F) != myId) return 0; // not for us
-    if (l == 2) return 2; // old-style ACK
+    if (l == 2) { nAck++; return 2; } // old-style ACK
     if ((buf[1] & 0x80) != 0) return 0; // not an ACK packet
+    nAck++;
     // it's an ACK from GW (should we check source addr?)
     adjustFreq(); // adjust based on what we measured, not what GW says...
+    // record the correction for the current temperature
+    bool newBucket = !(tc.valid & (1UL<<SX1231TempComp::bucket(tcTemp)));
+    tc.learn(tcTemp, (int32_t)(actFreq - nomFreq));
+    _tcBucket = SX1231TempComp::bucket(tcTemp);
+    if (newBucket) tcDirty = 255;
+    else if (tcDirty < 254) tcDirty++;
 #if ADJPOW
     if ((buf[2] & 0x80) != 0 && l > 4) { // there is an info trailer
         adjustPow(buf[l-2]);
@@ -340,6 +522,10 @@ void SX1231::addInfo(uint8_t *ptr) {
 // in the lower 6 bits and bit 7 for ?? as well as bit 6 for ??.
 // Note: the code is limited to len <62 because the FIFO is filled before initiating TX.
 void SX1231::send (uint8_t header, const void* ptr, int len) {
+    nTx++;
+    // on-air: preamble, sync, length byte, two header bytes, payload, crc
+    energy.airUs += (uint32_t)(5 + 3 + 1 + 2 + len + 2) * 8 * 1000000 / br;
+    energy.nPkt++;
     setMode(MODE_FS);
     //printf("{TX:%02x %02x}\n", (header & 0x3F) | _parity, (header & 0xC0) | myId);
     _regs.writePacket((header & 0x3F) | _parity, (header & 0xC0) | myId, ptr, len);
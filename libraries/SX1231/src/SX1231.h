@@ -7,6 +7,8 @@
 //  3..(N-1): payload data (max 63 bytes)
 //  N..(N+1): 16-bit crc
 
+#include <stdint.h>
+
 struct SX1231Regs {
     // read an 8-bit register
     virtual uint8_t readReg (uint8_t addr) const = 0;
@@ -71,14 +73,137 @@ struct SX1231Jeeh : SX1231Regs {
 
 #endif
 
+// SX1231Eeprom provides word-level access to non-volatile storage used to persist state the driver
+// has learned, such as the temperature compensation table.
+struct SX1231Eeprom {
+    // read 32-bit word idx
+    virtual uint32_t read (int idx) const = 0;
+    // write 32-bit word idx
+    virtual void write (int idx, uint32_t val) const = 0;
+};
+
+#if JEEH
+
+// SX1231EepromL0 stores words in the data EEPROM of an STM32L0, starting at the given offset.
+template< uint32_t offset =0 >
+struct SX1231EepromL0 : SX1231Eeprom {
+    static constexpr uint32_t base   = 0x08080000 + offset; // data EEPROM
+    static constexpr uint32_t flash  = 0x40022000;          // flash interface registers
+    static constexpr uint32_t pecr   = flash + 0x04;
+    static constexpr uint32_t pekeyr = flash + 0x0C;
+    static constexpr uint32_t sr     = flash + 0x18;
+
+    uint32_t read (int idx) const { return MMIO32(base + 4*idx); }
+
+    void write (int idx, uint32_t val) const {
+        if (MMIO32(pecr) & 1) { // PELOCK: unlock data EEPROM
+            MMIO32(pekeyr) = 0x89ABCDEF;
+            MMIO32(pekeyr) = 0x02030405;
+        }
+        MMIO32(base + 4*idx) = val;
+        while (MMIO32(sr) & 1) ; // wait for BSY to clear
+        MMIO32(pecr) |= 1; // re-lock
+    }
+};
+
+#endif
+
+// SX1231EepromRam emulates the EEPROM in RAM for host-side testing. Erased words read as zero, as
+// on the STM32L0, and the number of writes to each word is tracked to check wear-levelling.
+template< int words >
+struct SX1231EepromRam : SX1231Eeprom {
+    SX1231EepromRam() { for (int i=0; i<words; i++) mem[i] = wear[i] = 0; }
+
+    uint32_t read (int idx) const { return idx < words ? mem[idx] : 0; }
+    void write (int idx, uint32_t val) const {
+        if (idx >= words) return;
+        mem[idx] = val;
+        wear[idx]++;
+    }
+
+    mutable uint32_t mem[words];
+    mutable uint32_t wear[words];
+};
+
+// SX1231State is the record persisted to EEPROM so a node converges instantly after a reset.
+// Records are written round-robin to a ring of slots for wear-levelling, the valid record with
+// the highest sequence number is the current one.
+struct SX1231State {
+    static constexpr int base = 16;  // first EEPROM word of the ring, after the TempComp table
+    static constexpr int nSlots = 8; // number of slots in the ring
+
+    uint32_t seq;      // sequence number, incremented with each save
+    int32_t freqCorr;  // actFreq - nomFreq in Hz
+    int8_t txpow;      // tx power in dB
+    int8_t margin;     // signal margin of last packet received
+    int16_t rssi;      // RSSI of last packet received
+    uint16_t nTx;      // packets sent
+    uint16_t nAck;     // ACKs received
+    uint32_t sum;      // checksum over the preceding words
+
+    static constexpr int nWords = 5;
+    uint32_t checksum () const;
+};
+
+// SX1231TempComp holds the frequency correction learned for each temperature bucket. The radio's
+// crystal drifts with temperature and the FEI of received ACKs only corrects for it after the
+// fact, so the correction is recorded per bucket and used to pre-correct the next transmission.
+struct SX1231TempComp {
+    static constexpr int tMin = -20;    // lowest temperature covered, in centigrade
+    static constexpr int tStep = 4;     // bucket width in centigrade
+    static constexpr int nBuckets = 24; // covers -20C..75C
+    static constexpr uint32_t magic = 0x54430001; // "TC" v1 in EEPROM
+
+    int16_t corr[nBuckets]; // frequency correction relative to nominal in Hz
+    uint32_t valid;         // bitmap of buckets that have been learned
+
+    static int bucket (int16_t degC) {
+        int b = (degC - tMin) / tStep;
+        return b < 0 ? 0 : b >= nBuckets ? nBuckets-1 : b;
+    }
+    bool lookup (int16_t degC, int32_t &hz) const;
+    void learn (int16_t degC, int32_t hz);
+};
+
+// SX1231Energy accumulates the time the radio spends in each mode and estimates the charge drawn
+// from the per-mode currents. The TX current is modeled as a base current plus a per-mW term for
+// the output power, which fits the RFM69 datasheet within a few percent across -18dBm..13dBm.
+// The currents are configurable, the defaults are for an RFM69CW using PA0.
+struct SX1231Energy {
+    uint32_t modeUA[5]; // current in uA for sleep, standby, fs, tx (base), rx
+    uint16_t txUAperMW; // additional tx current in uA per mW of output power
+
+    uint32_t modeUs[5]; // time spent in each mode in us
+    uint32_t airUs;     // computed on-air time of packets sent in us
+    uint16_t nPkt;      // packets sent
+    uint64_t charge;    // charge drawn in uA*us
+
+    SX1231Energy() : modeUA{ 1, 1250, 9000, 18700, 16000 }, txUAperMW(1316) { reset(); }
+
+    // reset clears the counters, e.g. at the start of a reporting cycle, but not the currents
+    void reset () {
+        for (int i=0; i<5; i++) modeUs[i] = 0;
+        airUs = 0;
+        nPkt = 0;
+        charge = 0;
+    }
+    uint32_t nAh () const { return charge / 3600000ULL; } // charge in nAh
+    uint32_t uAh () const { return charge / 3600000000ULL; } // charge in uAh
+};
+
 struct SX1231 {
-    SX1231(SX1231Regs &regs) : _regs(regs) {}
+    SX1231(SX1231Regs &regs, const SX1231Eeprom *ee =0) : _regs(regs), _ee(ee), _clock(0) {}
 
-    bool init (uint8_t id, uint8_t group, int freq);
+    bool init (uint8_t id, uint8_t group, int freq); // restores saved state if there is an EEPROM
 
     void txPower (int8_t dBm); // set power: -18dBm..13dBm
     void adjustPow (uint8_t margin, uint8_t target);
     void adjustFreq();
+    void tempComp (int16_t degC); // pre-correct frequency for the current temperature
+    bool loadTempComp (); // restore learned table from EEPROM, true if valid
+    void saveTempComp (); // persist learned table to EEPROM, clears tcDirty
+    bool loadState ();    // restore frequency, power and link stats from EEPROM, true if valid
+    bool saveState (bool force =false); // persist state if it changed materially, true if saved
 
     int receive (void* ptr, int len);
     void send (uint8_t header, const void* ptr, int len);
@@ -88,12 +213,26 @@ struct SX1231 {
     void sleep (); // put the radio to sleep to save power
     int8_t linkMargin (int8_t snr);
     void info();
+    void setClock (uint32_t (*usClock)()); // enable energy accounting using a microsecond clock
 
     // current config
     uint8_t myId;
+    uint32_t nomFreq; // nominal frequency as passed to init()
     uint32_t actFreq; // actual frequency
     int8_t txpow;     // current tx power in dB
 
+    // temperature compensation
+    SX1231TempComp tc;
+    int16_t tcTemp;   // temperature last passed to tempComp()
+    uint8_t tcDirty;  // updates since last save, 255 if a new bucket was learned
+
+    // link statistics
+    uint16_t nTx;     // packets sent
+    uint16_t nAck;    // ACKs received
+
+    // airtime and energy accounting, see setClock()
+    SX1231Energy energy;
+
     // info about last packet received
     int32_t fei;    // freq error of last pkt received
     int16_t rssi;   // RSSI of last packet received
@@ -145,6 +284,7 @@ struct SX1231 {
     };
 
     void setMode (uint8_t newMode);
+    void account (); // add time spent in the current mode to the energy counters
     void configure (const uint8_t* p);
     void setFreq (uint32_t freq);
     void savePktMeta();
@@ -152,5 +292,11 @@ struct SX1231 {
 
     uint8_t _parity;
     uint8_t _mode;
+    uint32_t _modeStart; // clock() when _mode was entered
+    int8_t _tcBucket; // bucket last used to pre-correct the frequency, -1 if none
     SX1231Regs &_regs;
+    const SX1231Eeprom *_ee;
+    uint32_t (*_clock)();
+    SX1231State _saved; // last state saved or restored
+    int8_t _slot;       // ring slot of _saved, -1 if none
 };
@@ -0,0 +1,75 @@
+// This example samples a pin at 20kHz using STM32ADC with a timer trigger and circular DMA and
+// reduces each half-buffer in the DMA callback: a CIC filter decimates the stream by 16, and
+// the envelope and moving RMS summarize it. The loop prints one summary per second, which is
+// small enough to be sent over the radio instead of the raw samples.
+#include <Arduino.h>
+#include <stm32l0xx_ll_bus.h>
+#include <stm32l0xx_ll_tim.h>
+#include <stm32l0xx_ll_adc.h>
+#include <STM32ADC.h>
+#include <SampleDSP.h>
+
+#define pinIN   PB1
+
+#define maxSamples      1000
+#define sampleFreqHz    20000
+
+uint16_t buffer[maxSamples];
+uint16_t decimated[maxSamples/2/16 + 1];
+
+STM32ADC myADC(ADC1);
+CicDecimator<4> cic;    // by 16, 3 stages
+MovingRms<8> rms;       // over 256 samples
+Envelope env;
+volatile uint32_t halves;
+volatile uint32_t busyUs;    // time spent in the callback
+
+// bufferFull is called from the DMA interrupt each time half the buffer is filled.
+void bufferFull(uint16_t *samples, uint16_t count) {
+    uint32_t t0 = micros();
+    uint16_t n = cic.process(samples, count, decimated);
+    env.process(samples, count);
+    rms.process(decimated, n);
+    busyUs += micros() - t0;
+    halves++;
+}
+
+// startTimer has TIM2 generate a TRGO update event at the requested rate.
+void startTimer(uint32_t hz) {
+    LL_APB1_GRP1_EnableClock(LL_APB1_GRP1_PERIPH_TIM2);
+    LL_TIM_SetPrescaler(TIM2, 0);
+    LL_TIM_SetAutoReload(TIM2, SystemCoreClock / hz - 1);
+    LL_TIM_SetTriggerOutput(TIM2, LL_TIM_TRGO_UPDATE);
+    LL_TIM_EnableCounter(TIM2);
+}
+
+void setup() {
+    pinMode(pinIN, INPUT_ANALOG);
+    Serial.begin(115200);
+    Serial.println("START");
+
+    myADC.begin(pinIN);
+    myADC.setSampleRate(LL_ADC_SAMPLINGTIME_12CYCLES_5);
+    myADC.setDMA(buffer, maxSamples, bufferFull);
+    myADC.setTrigger(LL_ADC_REG_TRIG_EXT_TIM2_TRGO);
+    myADC.startConversion();
+    startTimer(sampleFreqHz);
+}
+
+void loop() {
+    // each half is 25ms at 20kHz, print once a second
+    if (halves >= 2 * sampleFreqHz / maxSamples) {
+        noInterrupts();
+        uint16_t lo = env.min, hi = env.max, mean = env.mean(), ac = rms.rms();
+        uint32_t busy = busyUs;
+        env.reset();
+        halves = 0;
+        busyUs = 0;
+        interrupts();
+        Serial.print("min: "); Serial.print(lo);
+        Serial.print(" max: "); Serial.print(hi);
+        Serial.print(" mean: "); Serial.print(mean);
+        Serial.print(" rms: "); Serial.print(ac);
+        Serial.print(" cpu: "); Serial.print(busy / 10000); Serial.println("%");
+    }
+}
@@ -0,0 +1,91 @@
+// Host benchmark for the SampleDSP block processors. It feeds each stage a synthetic 12-bit
+// signal in blocks the size of a DMA half-buffer and reports the throughput in samples/s, plus
+// the results so the numbers can be checked against the signal parameters.
+//
+// Build and run on Linux from this directory:
+//   g++ -O2 -I../src bench.cpp ../src/SampleDSP.cpp -o bench && ./bench
+//
+// The host is much faster than a Cortex-M0+, but the relative cost of the stages carries over
+// since they use the same 32-bit integer operations.
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+#include "SampleDSP.h"
+
+static const int blockLen = 1000;        // samples per DMA half-buffer
+static const int numBlocks = 20000;      // 20M samples per stage
+static uint16_t signal[blockLen];
+static uint16_t work[blockLen];
+
+// 31-tap low-pass at fs/8 for a decimation by 4, Hamming window, Q15
+static const int16_t lowpass[31] = {
+    -39, -67, -68, 0, 156, 324, 327, 0, -621, -1189, -1139, 0, 2249, 5022, 7322, 8216,
+    7322, 5022, 2249, 0, -1139, -1189, -621, 0, 327, 324, 156, 0, -68, -67, -39,
+};
+
+typedef std::chrono::steady_clock Clock;
+
+static void report(const char *name, Clock::time_point t0, long samples) {
+    double s = std::chrono::duration<double>(Clock::now() - t0).count();
+    printf("%-28s %8.1f Msamples/s\n", name, samples / s / 1e6);
+}
+
+int main() {
+    // 2048 mV-ish DC with a 500 count amplitude sine, 50 samples per period, plus dither
+    uint32_t rnd = 1;
+    for (int i=0; i<blockLen; i++) {
+        rnd = rnd * 1103515245 + 12345;
+        signal[i] = 2048 + lround(500 * sin(2 * M_PI * i / 50)) + (int)((rnd >> 16) & 3) - 2;
+    }
+    printf("signal: mean 2048, rms %.1f\n", 500 / sqrt(2));
+    long samples = (long)blockLen * numBlocks;
+
+    {
+        CicDecimator<4> cic; // 3 stages, by 16
+        uint32_t outs = 0;
+        uint16_t k = 0;
+        Clock::time_point t0 = Clock::now();
+        for (int b=0; b<numBlocks; b++) {
+            k = cic.process(signal, blockLen, work);
+            outs += k;
+        }
+        report("CicDecimator<4,3>", t0, samples);
+        printf("  outputs %u, last %u\n", outs, work[k-1]);
+    }
+    {
+        FirDecimator<31, 4> fir(lowpass);
+        uint32_t outs = 0;
+        uint16_t k = 0;
+        Clock::time_point t0 = Clock::now();
+        for (int b=0; b<numBlocks; b++) {
+            k = fir.process(signal, blockLen, work);
+            outs += k;
+        }
+        report("FirDecimator<31,4>", t0, samples);
+        printf("  outputs %u, last %u\n", outs, work[k-1]);
+    }
+    {
+        MovingRms<8> rms;
+        uint32_t acc = 0;
+        Clock::time_point t0 = Clock::now();
+        for (int b=0; b<numBlocks; b++) {
+            rms.process(signal, blockLen);
+            acc += rms.rms(); // once per block, as on the uC
+        }
+        report("MovingRms<8>", t0, samples);
+        printf("  mean %u, rms %u\n", rms.mean(), acc / numBlocks);
+    }
+    {
+        Envelope env;
+        uint32_t acc = 0;
+        Clock::time_point t0 = Clock::now();
+        for (int b=0; b<numBlocks; b++) {
+            env.reset();
+            env.process(signal, blockLen);
+            acc += env.mean();
+        }
+        report("Envelope", t0, samples);
+        printf("  min %u, max %u, mean %u\n", env.min, env.max, acc / numBlocks);
+    }
+    return 0;
+}
@@ -0,0 +1,34 @@
+// Fixed-point block processors, see SampleDSP.h
+#include "SampleDSP.h"
+
+// isqrt uses the bit-by-bit method, which only needs shifts, adds and compares.
+uint32_t isqrt(uint64_t v) {
+    uint64_t res = 0;
+    uint64_t bit = (uint64_t)1 << 62;
+    while (bit > v) bit >>= 2;
+    while (bit) {
+        if (v >= res + bit) {
+            v -= res + bit;
+            res = (res >> 1) + bit;
+        } else {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)res;
+}
+
+void Envelope::process(const uint16_t *in, uint16_t n) {
+    uint16_t lo = min, hi = max;
+    uint32_t s = 0;
+    for (const uint16_t *end = in + n; in != end; in++) {
+        uint16_t v = *in;
+        if (v < lo) lo = v;
+        if (v > hi) hi = v;
+        s += v;
+    }
+    min = lo;
+    max = hi;
+    sum += s;
+    count += n;
+}
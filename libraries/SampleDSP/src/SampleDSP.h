@@ -0,0 +1,176 @@
+// Fixed-point block processors for streams of ADC samples
+//
+// The processors reduce a stream of samples on-chip, e.g., to send a summary over the radio
+// instead of the raw data. They are meant to run on each half-buffer handed out by the DMA
+// callback of STM32ADC::setDMA, and keep their state across calls such that the stream is
+// processed without seams. There is no allocation and no floating point, sizes are template
+// parameters and all arithmetic is 32-bit integer, which the Cortex-M0+ and M3 do in one cycle
+// per operation; the only 64-bit operations are in the per-block queries.
+//
+// Samples are unsigned 16-bit values as produced by the ADC, i.e., 12 bits or up to 16 bits with
+// oversampling. The decimators may write their output over their input, i.e., out == in.
+#ifndef _SAMPLEDSP_
+#define _SAMPLEDSP_
+
+#include <stdint.h>
+
+// isqrt returns the integer square root of v, rounded down.
+uint32_t isqrt(uint64_t v);
+
+// CicDecimator is an N-stage cascaded integrator-comb filter that decimates by 2^LOG2R. It only
+// needs additions, uses the wrap-around of 32-bit arithmetic by design, and its gain of R^N is
+// removed by a shift so the output has the scale of the input. The droop in the passband is that
+// of N moving averages of length R, follow it by a short FirDecimator to compensate if needed.
+template <uint8_t LOG2R, uint8_t N =3, uint8_t BITS =12>
+class CicDecimator {
+public:
+    static constexpr uint16_t ratio = 1 << LOG2R;
+    static_assert(N >= 1 && BITS + N*LOG2R <= 32, "CIC register growth exceeds 32 bits");
+
+    CicDecimator() { reset(); }
+
+    void reset() {
+        for (int s=0; s<N; s++) _integ[s] = _comb[s] = 0;
+        _phase = 0;
+    }
+
+    // process filters n samples and writes one output per ratio inputs to out, it returns the
+    // number of outputs.
+    uint16_t process(const uint16_t *in, uint16_t n, uint16_t *out) {
+        uint16_t k = 0;
+        uint16_t phase = _phase;
+        for (const uint16_t *end = in + n; in != end; in++) {
+            uint32_t v = *in;
+            for (int s=0; s<N; s++) v = _integ[s] += v;
+            if (++phase == ratio) {
+                phase = 0;
+                for (int s=0; s<N; s++) {
+                    uint32_t d = v - _comb[s];
+                    _comb[s] = v;
+                    v = d;
+                }
+                out[k++] = v >> (N*LOG2R);
+            }
+        }
+        _phase = phase;
+        return k;
+    }
+
+private:
+    uint32_t _integ[N];
+    uint32_t _comb[N];
+    uint16_t _phase;
+};
+
+// FirDecimator is a TAPS-tap FIR filter with Q15 coefficients (32768 = 1.0) that decimates by R,
+// it only computes the outputs it keeps, i.e., it costs TAPS multiply-adds per R inputs. coef[0]
+// applies to the oldest sample. To keep the 32-bit accumulator from overflowing the sum of the
+// absolute coefficient values must stay below 16.0 with 12-bit samples and below 1.0 with 16-bit
+// samples, a unity-gain low-pass typically has a sum of 1.0..1.5. Outputs are clamped to
+// 0..65535.
+template <uint8_t TAPS, uint8_t R =1>
+class FirDecimator {
+public:
+    FirDecimator(const int16_t *coef) : _coef(coef) { reset(); }
+
+    void reset() {
+        for (int i=0; i<2*TAPS; i++) _hist[i] = 0;
+        _pos = 0;
+        _phase = 0;
+    }
+
+    // process filters n samples and writes one output per R inputs to out, it returns the number
+    // of outputs.
+    uint16_t process(const uint16_t *in, uint16_t n, uint16_t *out) {
+        uint16_t k = 0;
+        for (const uint16_t *end = in + n; in != end; in++) {
+            // the history is stored twice so the last TAPS samples are always contiguous
+            _hist[_pos] = _hist[_pos+TAPS] = *in;
+            if (++_pos == TAPS) _pos = 0;
+            if (++_phase < R) continue;
+            _phase = 0;
+            const uint16_t *h = _hist + _pos; // oldest sample first
+            int32_t acc = 1 << 14; // rounding
+            for (int t=0; t<TAPS; t++) acc += (int32_t)h[t] * _coef[t];
+            acc >>= 15;
+            out[k++] = acc < 0 ? 0 : acc > 0xffff ? 0xffff : acc;
+        }
+        return k;
+    }
+
+private:
+    const int16_t *_coef;
+    uint16_t _hist[2*TAPS];
+    uint8_t _pos;
+    uint8_t _phase;
+};
+
+// MovingRms tracks the mean and the RMS of the AC component (i.e. the standard deviation) of the
+// last 2^LOG2W samples. It keeps running sums, so the cost per sample is independent of the
+// window, and computes the square root only when queried, typically once per block.
+template <uint8_t LOG2W, uint8_t BITS =12>
+class MovingRms {
+public:
+    static constexpr uint16_t window = 1 << LOG2W;
+    static_assert(2*BITS + LOG2W <= 32, "window too large for the sum of squares");
+
+    MovingRms() { reset(); }
+
+    void reset() {
+        for (int i=0; i<window; i++) _win[i] = 0;
+        _pos = 0;
+        _sum = _sumSq = 0;
+    }
+
+    void process(const uint16_t *in, uint16_t n) {
+        uint16_t pos = _pos;
+        uint32_t sum = _sum, sumSq = _sumSq;
+        for (const uint16_t *end = in + n; in != end; in++) {
+            uint32_t v = *in, old = _win[pos];
+            _win[pos] = v;
+            pos = (pos + 1) & (window - 1);
+            sum += v - old;
+            sumSq += v*v - old*old;
+        }
+        _pos = pos;
+        _sum = sum;
+        _sumSq = sumSq;
+    }
+
+    uint16_t mean() const { return (_sum + window/2) >> LOG2W; }
+
+    // rms returns sqrt(E[x^2] - E[x]^2) over the window
+    uint16_t rms() const {
+        uint64_t var = ((uint64_t)_sumSq << LOG2W) - (uint64_t)_sum * _sum;
+        return isqrt(var >> (2*LOG2W));
+    }
+
+private:
+    uint16_t _win[window];
+    uint16_t _pos;
+    uint32_t _sum;
+    uint32_t _sumSq;
+};
+
+// Envelope tracks the min, max and mean of all samples since the last reset, e.g., over the
+// interval between two radio packets.
+struct Envelope {
+    Envelope() { reset(); }
+
+    void reset() {
+        min = 0xffff;
+        max = 0;
+        sum = 0;
+        count = 0;
+    }
+
+    void process(const uint16_t *in, uint16_t n);
+
+    uint16_t mean() const { return count ? (sum + count/2) / count : 0; }
+
+    uint16_t min, max;
+    uint32_t sum;   // up to 65536 16-bit samples, or 2^20 12-bit samples
+    uint32_t count;
+};
+
+#endif
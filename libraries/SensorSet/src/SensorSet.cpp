@@ -0,0 +1,42 @@
+// Reading a set of sensors with overlapping conversions, see SensorSet.h
+#include "SensorSet.h"
+
+bool SensorSet::add (Sensor &s) {
+    if (_n >= maxSensors) return false;
+    // insertion sort by descending latency so the slowest sensor gets started first
+    int i = _n++;
+    while (i > 0 && _sensors[i-1]->latency() < s.latency()) {
+        _sensors[i] = _sensors[i-1];
+        i--;
+    }
+    _sensors[i] = &s;
+    return true;
+}
+
+uint32_t SensorSet::read () {
+    uint32_t t0 = _msClock();
+    uint32_t due[maxSensors]; // ms after t0 at which each sensor is ready
+    bool done[maxSensors];
+    for (int i=0; i<_n; i++) {
+        due[i] = _msClock() - t0 + _sensors[i]->start();
+        done[i] = false;
+    }
+
+    // collect in order of readiness, sleeping while nothing is ready
+    sleptMs = 0;
+    for (int left = _n; left > 0; ) {
+        uint32_t now = _msClock() - t0;
+        int next = -1;
+        for (int i=0; i<_n; i++)
+            if (!done[i] && (next < 0 || due[i] < due[next])) next = i;
+        if (due[next] > now) {
+            _sleepMs(due[next] - now);
+            sleptMs += _msClock() - t0 - now;
+            continue; // sleepMs may return early
+        }
+        _sensors[next]->collect();
+        done[next] = true;
+        left--;
+    }
+    return _msClock() - t0;
+}
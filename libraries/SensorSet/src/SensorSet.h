@@ -0,0 +1,50 @@
+// Reading a set of sensors with overlapping conversions
+//
+// Most sensors need some time between starting a conversion and having a result, e.g. 30-250ms
+// for an MCP9808 depending on the resolution. Reading them one after the other keeps the uC
+// awake for the sum of these latencies, the SensorSet starts all conversions back-to-back, sleeps
+// until the next one is due, collects it, and so on, so a reading cycle takes as long as the
+// slowest sensor. Sensors with the longest latency are started first.
+//
+// A sensor that measures synchronously, e.g. the uC's ADC, returns 0 from start() and does its
+// work in collect(), which then runs while the slower sensors are converting.
+#ifndef _SENSORSET_
+#define _SENSORSET_
+
+#include <stdint.h>
+
+struct Sensor {
+    // latency returns the ms between start() and the result being ready, it is used to order
+    // the starts, start() returns the actual latency for this conversion
+    virtual uint32_t latency () const = 0;
+    // start kicks off a conversion and returns the number of ms before collect() can be called
+    virtual uint32_t start () = 0;
+    // collect reads the result and powers the sensor down
+    virtual void collect () = 0;
+};
+
+class SensorSet {
+public:
+    static constexpr int maxSensors = 8;
+
+    // msClock returns a millisecond timestamp, sleepMs sleeps for about the given number of ms
+    // and may return early, e.g. wait_ms or a lambda around STM32Stop::stop
+    SensorSet(uint32_t (*msClock)(), void (*sleepMs)(uint32_t))
+        : _msClock(msClock), _sleepMs(sleepMs), _n(0) {};
+
+    bool add (Sensor &s); // returns false if the set is full
+
+    // read runs one cycle: start all sensors, sleep until each one is ready and collect it, it
+    // returns the number of ms the cycle took
+    uint32_t read ();
+
+    uint32_t sleptMs; // ms spent in sleepMs during the last read
+
+private:
+    uint32_t (*_msClock)();
+    void (*_sleepMs)(uint32_t);
+    Sensor *_sensors[maxSensors];
+    uint8_t _n;
+};
+
+#endif
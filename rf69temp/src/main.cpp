@@ -3,6 +3,9 @@
 #include <jee.h>
 #include <MCP9808.h>
 #include <SX1231.h>
+#include <DualPredict.h>
+#include <STM32Stop.h>
+#include <SensorSet.h>
 #include <jee/varint.h>
 
 UartDev< PinA<9>, PinA<10> > console;
@@ -13,9 +16,11 @@ int printf(const char* fmt, ...) {
 }
 
 I2cBus< PinB<7>, PinB<6> > i2c;                     // standard I2C pins for SDA and SCL
-MCP9808Jeeh< decltype(i2c) > mcp9808regs;           // std. chip on TvE's JZ4/JZ5
+MCP9808I2cL0 mcp9808regs;                           // std. chip on TvE's JZ4/JZ5, I2C1 on the same pins
 MCP9808 sensor(mcp9808regs);
 
+extern "C" void I2C1_IRQHandler () { mcp9808regs.irq(); }
+
 #ifdef JNZ4
 PinA<8> led;                                        // LED, active low
 PinA<1> batPin;                                     // battery voltage divider
@@ -26,9 +31,35 @@ PinB<1> batPin;                                     // battery voltage divider
 SpiGpio< PinB<5>, PinB<4>, PinB<3>, PinC<14> > spi; // default SPI1 pins
 #endif
 
+// Build with -DMCP_ALERT=1 to sleep until the MCP9808 signals that the temperature left a window
+// around the last reading instead of waking up every `rate` seconds. This needs the sensor's ALERT
+// output wired to a uC pin, PA0 by default.
+#ifndef MCP_ALERT
+#define MCP_ALERT 0
+#endif
+#ifndef MCP_ALERT_PORT
+#define MCP_ALERT_PORT 'A'
+#define MCP_ALERT_PIN 0
+#endif
+
 SX1231Jeeh< decltype(spi) > sx1231regs;
-SX1231 rf(sx1231regs);                              // RFM69 radio module
+SX1231EepromL0<> eeprom;                            // persists learned radio state
+SX1231 rf(sx1231regs, &eeprom);                     // RFM69 radio module
 ADC<1> batVcc;                                      // ADC to measure battery voltage
+STM32Stop lowPower;                                 // STOP mode between readings
+
+// micros returns a microsecond timestamp based on the ms ticks plus the SysTick down-counter, it
+// is used for the radio's energy accounting.
+static uint32_t micros () {
+    constexpr uint32_t stLoad = 0xE000E014, stVal = 0xE000E018;
+    uint32_t t, v;
+    do {
+        t = ticks;
+        v = MMIO32(stVal);
+    } while (t != ticks);
+    uint32_t load = MMIO32(stLoad);
+    return t * 1000 + (load - v) * 1000 / (load + 1);
+}
 
 // batVoltage returns the battery voltage in mV
 static int batVoltage () {
@@ -37,9 +68,9 @@ static int batVoltage () {
     return (adc * vcc) / 4095;  // result in mV, with 1:2 divider
 }
 
-static bool sendPkt(int32_t data[], int n) {
+static bool sendPkt(uint8_t type, int32_t data[], int n) {
     uint8_t pkt[64];
-    pkt[0] = 0x80 + 1; // temp sensor packet type
+    pkt[0] = 0x80 + type; // packet type, 0x80 flags the info trailer
     int len = encodeVarint(data, n, pkt+1, 63);
     len++; // account for pkt[0]
     rf.addInfo(pkt+len); len+=2;
@@ -69,13 +100,12 @@ void setup() {
 
     i2c.init();
     detectI2c(i2c);
+    mcp9808regs.init(); // switch the pins over to the I2C1 peripheral
 
     if (!sensor.init()) {
         printf("OOPS, can't init MCP9808!\r\n");
         while(1) ;
     }
-    sensor.convert(); // flashing of LED is enough delay after enable
-    //wait_ms(sensor.convert()); // flashing of LED is enough delay
 
     spi.init();
     if (!rf.init(62, 6, 912500)) {  // node 62, group 6, 912.5 MHz
@@ -83,47 +113,222 @@ void setup() {
         while(1) ;
     }
     rf.info();
+    rf.setClock(micros);
+    printf("Radio state: f=%d pow=%d tx=%d ack=%d tc=%08x\r\n",
+            rf.actFreq, rf.txpow, rf.nTx, rf.nAck, rf.tc.valid);
 
     batPin.mode(Pinmode::in_analog);
     batVcc.init();
 
+    lowPower.begin();
+    lowPower.calibrate([]() -> uint32_t { return ticks; });
+    lowPower.measureLatency();
+    printf("LSI: %dHz, wake-up latency: %dus\r\n", lowPower.hz, lowPower.wakeUs);
+
+    if (MCP_ALERT) {
+        // comparator mode: ALERT stays asserted while outside the window, the sensor keeps
+        // converting from here on
+        lowPower.wakeOnPin(MCP_ALERT_PORT, MCP_ALERT_PIN);
+        sensor.setAlert();
+        sensor.convert();
+    }
+
     for (int i=0; i<5; i++) { led = 1-led; wait_ms(200); }
     wait_ms(1000);
     printf("Setup done.\r\n");
 }
 
-static constexpr uint16_t rate = 60; // standard interval between readings
+static constexpr uint16_t rate = 60; // standard interval between readings in seconds
+static constexpr uint16_t maxRate = 8*rate; // longest interval when ACKs are missed
+static constexpr uint16_t heartbeat = 15*60; // max seconds without a report
+static constexpr int32_t tBound = 20; // temperature prediction error that triggers a report, 1/100 C
+static constexpr int32_t vBound = 50; // battery voltage prediction error that triggers a report, mV
+static constexpr uint8_t resyncEvery = 16; // reports between absolute values
 static uint16_t rate_now = rate; // current rate
 static uint16_t missed_acks = 0; // number of consecitive missed acks
 static uint16_t blinks = 200; // number of times to blink LED for ack before going quiet
 static uint16_t vMin = 0; // minimum battery voltage measured
 static uint16_t vStart = 0; // battery voltage measured when coming out of sleep
 
+// Current estimates used to report the expected average current, see STM32Stop::avgCurrent. The
+// awake current is for the uC at 16MHz plus the MCP9808 converting, the stop current includes
+// the sleeping MCP9808 and radio as well as the battery voltage divider. In MCP_ALERT mode the
+// MCP9808 converts continuously, which costs ~200uA, and the node sleeps up to `heartbeat`.
+static constexpr uint32_t awakeUA = 2500;
+static constexpr uint32_t stopUA = MCP_ALERT ? 205 : 5;
+static constexpr int32_t tCrit = 8500; // critical temperature for the ALERT output, 1/100 C
+
+// The temperature and battery voltage are predicted from their trend using the same predictor as
+// the gateway, see DualPredict.h. Only readings that deviate from the prediction are sent, as
+// residuals, in packets of type 3: steps (0 for absolute values), temperature, battery voltage,
+// followed by txpow, uC temperature, vMin, radio nAh, radio ms and the report's sequence number.
+// The gateway only sniffs the packets, it may miss one the node got ACKed, so it uses the
+// sequence number to detect the loss and every resyncEvery'th report carries absolute values to
+// get it back in sync.
+static DualPredict tPred, vPred;
+static uint16_t steps; // readings since the predictors' anchor
+static uint32_t anchorAt; // ticks of the predictors' anchor, used to count steps in MCP_ALERT mode
+static bool resync = true; // send absolute values and reset the predictors
+static uint8_t seq; // sequence number of the next report, advances with every transmission
+static uint32_t sentAt; // ticks of last acknowledged report
+
+// mustSend decides whether a reading is worth transmitting: it is if the temperature or battery
+// voltage deviate from the prediction by more than the bound, if the predictors need to be
+// resynchronized with the gateway, or if the heartbeat interval has elapsed.
+static bool mustSend (int32_t t, int32_t v) {
+    if (resync) return true;
+    int32_t tr = tPred.residual(steps, t), vr = vPred.residual(steps, v);
+    if (tr >= tBound || tr <= -tBound) return true;
+    if (vr >= vBound || vr <= -vBound) return true;
+    return ticks - sentAt >= heartbeat * 1000UL;
+}
+
+// The sensors are read using a SensorSet so the battery and uC temperature get measured while the
+// MCP9808 converts, and the uC sleeps in STOP mode for the rest of the conversion. Further I2C
+// sensors only need a Sensor implementation and an add() in main.
+struct McpSensor : Sensor {
+    uint32_t latency () const { return MCP_ALERT ? 0 : MCP9808::convMs[MCP9808::RES_0_125C]; }
+    uint32_t start () {
+        if (MCP_ALERT) return 0; // converting continuously
+        return sensor.start(MCP9808::RES_0_125C); // tBound needs 0.125C
+    }
+    void collect () {
+        // fetch the temperature over I2C in the background, sleeping until done
+        sensor.startRead();
+        while (!sensor.readReady()) __asm("wfi");
+        t = sensor.readResult();
+        if (!MCP_ALERT) sensor.sleep();
+    }
+    int32_t t; // temperature in 1/100 C, MCP9808::NO_TEMP if the I2C read failed
+} mcpSensor;
+
+struct AdcSensor : Sensor {
+    uint32_t latency () const { return 0; }
+    uint32_t start () { return 0; }
+    void collect () {
+        vStart = batVoltage();
+        uCTemp = batVcc.readTemp();
+    }
+    int16_t uCTemp; // uC temperature in C
+} adcSensor;
+
+static void sleepMs (uint32_t ms) { ticks += lowPower.stop(ms); }
+SensorSet sensors([]() -> uint32_t { return ticks; }, sleepMs);
+
 int main() {
     setup();
+    sensors.add(mcpSensor);
+    sensors.add(adcSensor);
+
+    uint32_t rfNAhSent = 0, rfUsSent = 0; // radio energy counters at the last report
 
     while (true) {
-        vStart = batVoltage();
-        int16_t uCTemp = batVcc.readTemp();
-        int32_t t = sensor.read();
-
-        printf("vBat: %d.%03dV->%d.%03dV uC:%dC mcp:%d.%02dC\r\n",
-                vStart/1000, vStart%1000, vMin/1000, vMin%1000, uCTemp, t/100, t%100);
-
-        int32_t data[8] = { t, 0, 0, 0, rf.txpow, uCTemp, vStart, vMin };
-        if (sendPkt(data, 8)) {
-            if (blinks > 0) {
-                led = 0;
-                wait_ms(50);
-                led = 1;
-                blinks--;
-            }
-            printf("f=%d fei=%d pow=%d\n", rf.actFreq, rf.fei, rf.txpow);
+        uint32_t wokeAt = micros();
+        rf.account(); // include the time spent in the current mode
+        uint32_t rfNAhWoke = rf.energy.nAh();
+
+        sensors.read();
+        int32_t t = mcpSensor.t;
+        int16_t uCTemp = adcSensor.uCTemp;
+        if (MCP_ALERT) {
+            // wake-ups are irregular, count steps in units of `rate` since the anchor, at least
+            // one since 0 steps flags absolute values
+            steps = (ticks - anchorAt) / (rate * 1000UL);
+            if (steps == 0) steps = 1;
         } else {
-            printf("no-ack\r\n");
+            steps++;
+        }
+
+        // a failed read is neither fed to the predictors nor sent, the next reading takes its place
+        bool valid = t != MCP9808::NO_TEMP;
+        if (valid)
+            printf("vBat: %d.%03dV->%d.%03dV uC:%dC mcp:%d.%02dC pred:%d/%d\r\n",
+                    vStart/1000, vStart%1000, vMin/1000, vMin%1000, uCTemp, t/100, t%100,
+                    tPred.predict(steps), vPred.predict(steps));
+        else
+            printf("vBat: %d.%03dV->%d.%03dV uC:%dC mcp: read failed\r\n",
+                    vStart/1000, vStart%1000, vMin/1000, vMin%1000, uCTemp);
+
+        if (valid && mustSend(t, vStart)) {
+            rf.tempComp(uCTemp); // pre-correct the radio's frequency for the current temperature
+
+            // radio energy used since the previous report
+            const SX1231Energy& e = rf.energy;
+            uint32_t rfUs = e.modeUs[rf.MODE_FS] + e.modeUs[rf.MODE_TRANSMIT]
+                    + e.modeUs[rf.MODE_RECEIVE];
+            uint32_t nAh = rfNAhWoke - rfNAhSent;
+            uint32_t rfMs = (rfUs - rfUsSent) / 1000;
+            printf("radio: sb=%dms fs=%dus tx=%dus rx=%dus air=%dus pkts=%d charge=%dnAh\r\n",
+                    e.modeUs[rf.MODE_STANDBY]/1000, e.modeUs[rf.MODE_FS],
+                    e.modeUs[rf.MODE_TRANSMIT], e.modeUs[rf.MODE_RECEIVE], e.airUs, e.nPkt,
+                    e.nAh());
+            rfNAhSent = rfNAhWoke;
+            rfUsSent = rfUs;
+
+            int32_t tr = resync ? t : tPred.residual(steps, t);
+            int32_t vr = resync ? vStart : vPred.residual(steps, vStart);
+            int32_t data[9] = { resync ? 0 : steps, tr, vr, rf.txpow, uCTemp, vMin,
+                    (int32_t)nAh, (int32_t)rfMs, seq++ };
+            if (sendPkt(3, data, 9)) {
+                if (blinks > 0) {
+                    led = 0;
+                    wait_ms(50);
+                    led = 1;
+                    blinks--;
+                }
+                printf("f=%d fei=%d pow=%d\n", rf.actFreq, rf.fei, rf.txpow);
+                // save when a new temperature bucket got learned or enough updates accumulated
+                if (rf.tcDirty >= 32) rf.saveTempComp();
+                rf.saveState();
+                // the gateway has the same values now, move the predictors forward
+                if (resync) {
+                    tPred.reset(t);
+                    vPred.reset(vStart);
+                } else {
+                    tPred.update(steps, tr);
+                    vPred.update(steps, vr);
+                }
+                steps = 0;
+                anchorAt = ticks;
+                resync = seq % resyncEvery == 0;
+                sentAt = ticks;
+                missed_acks = 0;
+                rate_now = rate;
+            } else {
+                // the gateway may or may not have received the residuals, so start over with
+                // absolute values; back off exponentially: the GW may be down or out of range and
+                // retrying at full rate just burns the battery
+                resync = true;
+                missed_acks++;
+                if (rate_now < maxRate) rate_now *= 2;
+                printf("no-ack #%d, next in %ds\r\n", missed_acks, rate_now);
+            }
+        }
+        rf.sleep();
+        rf.account();
+
+        // report the average current this cycle would draw if repeated at the current rate
+        uint32_t cycleMs = (micros() - wokeAt) / 1000;
+        uint32_t awakeMs = cycleMs - sensors.sleptMs;
+        uint32_t avg = STM32Stop::avgCurrent(rate_now*1000, awakeMs, awakeUA,
+                rf.energy.nAh() - rfNAhWoke, stopUA);
+        printf("awake %dms, avg %d.%03duA at %ds\r\n", awakeMs, avg/1000, avg%1000, rate_now);
+
+        uint32_t ms = rate_now * 1000;
+        if (MCP_ALERT) {
+            // move the window around the current reading and sleep until the heartbeat is due,
+            // unless a resync or a failed read needs to be retried; ALERT only updates at the end
+            // of the next conversion, so don't go to sleep while it still reflects the old window
+            if (valid) sensor.setLimits(t - tBound, t + tBound, tCrit);
+            if (lowPower.pinActive()) wait_ms(MCP9808::convMs[MCP9808::RES_0_125C]);
+            uint32_t since = ticks - sentAt;
+            if (!resync && valid) ms = since < heartbeat * 1000UL ? heartbeat * 1000UL - since : 0;
+            cycleMs = 0;
         }
 
-        wait_ms(3000);
+        wait_ms(1); // let the UART finish sending
+        ticks += lowPower.stop(ms > cycleMs ? ms - cycleMs : 0); // SysTick doesn't run in STOP
+        if (lowPower.pinWoke) printf("alert\r\n");
     }
 }
 
@@ -22,6 +22,10 @@ SpiGpio< PinB<5>, PinB<4>, PinB<3>, PinB<0> > spiA;
 ILI9341< decltype(spiA), PinA<3> > lcd;
 #endif
 
+// waterfall1 stays synchronous: the LCD is on a bit-banged SPI, so each row is pushed from a
+// single buffer before the next one is swept. See LCD_SPI2 in waterfall2 for pushing rows by DMA
+// on hardware SPI2 while the next row is swept.
+
 // controlling the radio takes most time, use hardware SPI @ 9 MHz for it
 SpiHw< PinA<7>, PinA<6>, PinA<5>, PinA<4> > spiB;
 RF69< decltype(spiB) > rf;
@@ -54,6 +58,22 @@ static void initPalette () {
         *p++ = setRgb(255, (255*i)/5, (255*i)/5);
 };
 
+static uint32_t lastFrf = ~0; // FRF last written to the radio
+
+// setFrf writes the FRF bytes that changed since the previous call in a single SPI burst. The
+// radio increments the register address within a burst and applies the new frequency when the
+// LSB is written, so the burst always ends with the LSB.
+static void setFrf (uint32_t freq) {
+    uint32_t diff = (freq ^ lastFrf) & 0xFFFFFF;
+    int n = diff >> 16 ? 3 : diff >> 8 ? 2 : 1;
+    spiB.enable();
+    spiB.transfer((rf.REG_FRFMSB + 3 - n) | 0x80);
+    for (int i = n-1; i >= 0; --i)
+        spiB.transfer(freq >> (8*i));
+    spiB.disable();
+    lastFrf = freq;
+}
+
 int main () {
     fullSpeedClock();
     led.mode(Pinmode::out);
@@ -112,10 +132,7 @@ int main () {
 
             for (int x = 0; x < lcd.width; ++x) {
                 // step to a new frequency
-                uint32_t freq = first + x * step;
-                rf.writeReg(rf.REG_FRFMSB,   freq >> 16);
-                rf.writeReg(rf.REG_FRFMSB+1, freq >> 8);
-                rf.writeReg(rf.REG_FRFMSB+2, freq);
+                setFrf(first + x * step);
 
                 // take the average of 16 RSSI readings
                 int sum = 0;
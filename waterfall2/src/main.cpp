@@ -18,14 +18,31 @@ template <typename RF> void dumpRadioRegs(RF& rf);
 
 // Display
 
-#if 0
+// LCD_SPI2 selects an ILI9341 rewired to hardware SPI2 (see README), rows of pixels are then
+// pushed by DMA while the next row is computed. On the FPC connector's pins the SPI is
+// bit-banged and rows are pushed synchronously.
+#ifndef LCD_SPI2
+#define LCD_SPI2 0
+#endif
+
+#include <LcdDma.h>
+
+#if LCD_SPI2
+#include <jee/spi-ili9341.h>
+LcdSpiHw< PinB<15>, PinB<14>, PinB<13>, PinB<12>, 0x40003800 > spiA;
+ILI9341< decltype(spiA), PinB<6> > lcd;
+typedef LcdDma< decltype(lcd), decltype(spiA), 0x40003800 > LcdRow; // ILI9325: add 0x72
+extern "C" void dma1_channel5_isr () { LcdRow::irq(); }
+#elif 0
 SpiGpio< PinB<5>, PinB<4>, PinB<3>, PinB<0>, 1 > spiA;
 #include <jee/spi-ili9325.h>
 ILI9325< decltype(spiA) > lcd;
+typedef LcdPush< decltype(lcd) > LcdRow;
 #else
 #include <jee/spi-ili9341.h>
 SpiGpio< PinB<5>, PinB<4>, PinB<3>, PinB<0>, 0 > spiA;
 ILI9341< decltype(spiA), PinB<6> > lcd;
+typedef LcdPush< decltype(lcd) > LcdRow;
 #endif
 
 TextLcd< decltype(lcd) > text;
@@ -50,6 +67,8 @@ int group = 6;
 #include "waterfall.h"
 #include "monitor.h"
 
+extern "C" void tim2_isr () { if (sweepIsr) sweepIsr(); }
+
 // Button
 
 PinA<2> btn1; // button used to go to the next "mode"
@@ -153,12 +172,13 @@ int main () {
     MMIO32(afio + 0x04) |= 1 << 25; // disable JTAG, keep SWD enabled
 
     initLcd();
+    LcdRow::init();
     //testPattern();
     lcd.freeze(16, 0);
     text.top = 16;
 
-    waterfall<decltype(rf915), decltype(lcd)> wf1;
-    waterfall<decltype(rf433), decltype(lcd)> wf2;
+    waterfall<decltype(rf915), decltype(lcd), LcdRow> wf1;
+    waterfall<decltype(rf433), decltype(lcd), LcdRow> wf2;
     pktmon<decltype(fsk915), decltype(lcd)> pkt1;
 
     int which = 2;
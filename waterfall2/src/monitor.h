@@ -2,11 +2,17 @@
 // See https://github.com/jeelabs/jeeh/tree/master/examples/waterfall2
 
 #include <jee/varint.h>
+#include <DualPredict.h>
 
 // shared globally even when there are multiple waterfall specializations
 static uint8_t pktbuf[128];
 static int32_t ints[16];
 
+// per-node predictors for temperature and battery voltage, must match the node, see rf69temp
+static DualPredict tPreds[64], vPreds[64];
+static uint8_t nextSeq[64]; // sequence number of the next report expected from each node
+static bool predSynced[64]; // predictors hold the node's values, i.e., no report was missed
+
 template <typename R, typename L>
 class pktmon {
 
@@ -36,9 +42,15 @@ class pktmon {
                         pktbuf[1]&0x3f, pktbuf[0]&0x3f, ack,
                         -rf.rssi>>1, rf.afc/1000, len, typ);
 
+                int dlen = len;
+                if (typ >= 128 && len >= 5) {
+                    // packet carries a 2-byte info trailer, see SX1231::addInfo
+                    typ -= 128;
+                    dlen -= 2;
+                }
                 if (typ < 128) {
                     // varint encoded packet
-                    int c = decodeVarint(pktbuf+3, len-3, ints, 16);
+                    int c = decodeVarint(pktbuf+3, dlen-3, ints, 16);
                     if (c <= 0) {
                         printf(" oops, more than 16 ints!\r\n");
                         lcd_printf(" oops, more than 16 ints!\n");
@@ -59,6 +71,35 @@ class pktmon {
                         lcd_printf("    %3ddBm %dC %d.%03dV..%d.%03dV\n", ints[5], ints[6],
                                 ints[7]/1000, ints[7]%1000, ints[8]/1000, ints[8]%1000);
                         continue;
+                    case 3: { // temperature node sending residuals of the dual predictors
+                        if (c != 9) break;
+                        int node = pktbuf[1]&0x3f;
+                        uint8_t seq = ints[8];
+                        int32_t t, v;
+                        if (ints[0] == 0) { // absolute values
+                            tPreds[node].reset(t = ints[1]);
+                            vPreds[node].reset(v = ints[2]);
+                            predSynced[node] = true;
+                        } else if (predSynced[node] && seq == nextSeq[node]) {
+                            t = tPreds[node].update(ints[0], ints[1]);
+                            v = vPreds[node].update(ints[0], ints[2]);
+                        } else {
+                            // missed a report the node got ACKed, wait for absolute values
+                            predSynced[node] = false;
+                            printf(" seq %d, expected %d: lost sync (res %d %d)\r\n",
+                                    seq, nextSeq[node], ints[1], ints[2]);
+                            lcd_printf("lost sync #%d\n", seq);
+                            continue;
+                        }
+                        nextSeq[node] = seq + 1;
+                        printf(" %d.%02dC %d.%03dV (%d steps, res %d %d, #%d) %3ddBm %dC"
+                                " ..%d.%03dV %dnAh %dms\r\n",
+                                t/100, t%100, v/1000, v%1000, ints[0], ints[1], ints[2], seq,
+                                ints[3], ints[4], ints[5]/1000, ints[5]%1000, ints[6], ints[7]);
+                        lcd_printf("%d.%02dC %d.%03dV %d\n", t/100, t%100, v/1000, v%1000,
+                                ints[0]);
+                        continue;
+                    }
                     }
                     // default: print ints
                     for (int i=0; i<c; i++) {
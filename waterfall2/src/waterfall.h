@@ -19,8 +19,45 @@ static struct { uint32_t ctr, step, bwConf; } wfConfigs[] = {
   { 432500000, 82, 1 },
 };
 
+// Sweeps are paced by TIM2: each timer interrupt sets the next frequency and reads the RSSI, so
+// the main loop is free to render the previous row while a sweep runs. The DWT cycle counter
+// measures the achieved step rate and the jitter. The application routes the interrupt using:
+//   extern "C" void tim2_isr () { if (sweepIsr) sweepIsr(); }
+static void (*sweepIsr)();
 
-template <typename RF, typename LCD>
+// STM32F103 registers used for the sweep timing, TIM2 runs at 72MHz
+static constexpr uint32_t RCC_APB1ENR = 0x4002101C;
+static constexpr uint32_t TIM2_CR1    = 0x40000000;
+static constexpr uint32_t TIM2_DIER   = 0x4000000C;
+static constexpr uint32_t TIM2_SR     = 0x40000010;
+static constexpr uint32_t TIM2_EGR    = 0x40000014;
+static constexpr uint32_t TIM2_CNT    = 0x40000024;
+static constexpr uint32_t TIM2_PSC    = 0x40000028;
+static constexpr uint32_t TIM2_ARR    = 0x4000002C;
+static constexpr uint32_t NVIC_ISER   = 0xE000E100;
+static constexpr uint32_t DEMCR       = 0xE000EDFC;
+static constexpr uint32_t DWT_CTRL    = 0xE0001000;
+static constexpr uint32_t DWT_CYCCNT  = 0xE0001004;
+static constexpr int TIM2_IRQn = 28;
+
+// SweepStats describes the timing of the last sweep, intervals are in CPU cycles (72MHz).
+struct SweepStats {
+    uint32_t steps;     // steps in the sweep
+    uint32_t cycles;    // from the first to the last step
+    uint32_t minCycles; // shortest interval between two steps
+    uint32_t maxCycles; // longest interval between two steps
+    uint32_t overruns;  // steps that took longer than the timer period, cumulative
+    uint32_t frfBytes;  // FRF bytes written during the sweep, see waterfall::setFreq
+
+    // stepRate returns the achieved number of steps per second
+    uint32_t stepRate () const { return cycles ? (uint64_t)(steps-1) * 72000000 / cycles : 0; }
+    // jitterNs returns the difference between the longest and shortest interval in ns
+    uint32_t jitterNs () const { return (maxCycles - minCycles) * 1000 / 72; }
+};
+
+// waterfall is parameterized by the radio, the LCD and the way rows of pixels are pushed to the
+// LCD: LcdPush<LCD> (synchronous) or LcdDma<...>, see LcdDma.h.
+template <typename RF, typename LCD, typename PUSH = LcdPush<LCD> >
 class waterfall {
     private: int setRgb (uint8_t r, uint8_t g, uint8_t b) {
         return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);  // rgb565
@@ -44,50 +81,133 @@ class waterfall {
 
     public: waterfall() {
         initPalette();
+        stats.overruns = 0;
     }
 
+    public: SweepStats stats; // timing of the last sweep
+
+    // sweepDisplay converts a row into one of two pixel buffers and starts pushing it to the
+    // LCD, the conversion overlaps the push of the previous row if PUSH uses DMA.
     private: void sweepDisplay(LCD &lcd, int y, int count, uint8_t buf[]) {
-        uint16_t pixelRow[count];
+        uint16_t* pixelRow = pixelRows[pixelCur];
+        pixelCur ^= 1;
         for (int x = 0; x < count; ++x)
             pixelRow[x] = waterfall_palette[(uint8_t)(~buf[x])];
         if ((y & 0x1F) == 0) {
             for (int x=0; x<count; x+=count/4)
                 pixelRow[x] = 0xFFFF; // white dot
         }
+        PUSH::wait();                        // previous row is out, the LCD is free
         lcd.bounds(count-1, y, y+1);         // write one line and set scroll
-        lcd.pixels(0, y, pixelRow, count); // update display
+        PUSH::pixels(0, y, pixelRow, count); // update display
     }
 
+    // setFreq writes the FRF bytes that changed since the previous call in a single SPI burst.
+    // The radio increments the register address within a burst and applies the new frequency
+    // when the LSB is written, so the burst always ends with the LSB. While sweeping mostly the
+    // LSB changes, so a step takes one 2-byte SPI transfer instead of three.
     private: void setFreq(RF& rf, uint32_t freq) {
-        rf.writeReg(rf.REG_FRFMSB,   freq >> 16);
-        rf.writeReg(rf.REG_FRFMSB+1, freq >> 8);
-        rf.writeReg(rf.REG_FRFMSB+2, freq);
+        uint32_t diff = (freq ^ _frf) & 0xFFFFFF;
+        int n = diff >> 16 ? 3 : diff >> 8 ? 2 : 1;
+        rf.spi.enable();
+        rf.spi.transfer((rf.REG_FRFMSB + 3 - n) | 0x80);
+        for (int i = n-1; i >= 0; --i)
+            rf.spi.transfer(freq >> (8*i));
+        rf.spi.disable();
+        _frf = freq;
+        stats.frfBytes += n;
         //rf.writeReg(rf.REG_RXCONFIG, 0x28); // trigger RX restart not needed with FastHopOn
     }
 
-    // sweepRadio performs one spectrum sweep from first by step for count steps. It stores the
-    // samples in the provided buffer in the form -2*rssi, e.g., for -109dBm it stores 238.
-    // The speed of the sweep is govered by usDelay, which is the number of microseconds to wait
-    // between setting the frequency and reading the RSSI value.
-    private: void sweepRadio(RF& rf, uint32_t first, uint32_t step, int count, uint8_t usDelay, uint8_t buf[]) {
-        uint32_t freq = first;
-
-        SysTick<72000000> delay;
-        usDelay = usDelay >= 13 ? usDelay - 13 : 0;
-        setFreq(rf, freq);
-        delay.wait_us(100*usDelay);
-        for (int x = 0; x < count; ++x) {
-            if (usDelay > 0) delay.wait_us(usDelay);
-            // set next freq before reading RSSI, gains a few us and doesn't seem to
-            // affect the RSSI that is in the pipeline...
-            freq += step;
-            setFreq(rf, freq);
-            // read RSSI
-            *buf++ = rf.readReg(rf.REG_RSSIVALUE);
+    // initSweepTimer enables the TIM2 clock and interrupt and the DWT cycle counter.
+    private: static void initSweepTimer () {
+        MMIO32(RCC_APB1ENR) |= 1 << 0; // TIM2EN
+        MMIO32(NVIC_ISER) = 1 << TIM2_IRQn;
+        MMIO32(DEMCR) |= 1 << 24; // TRCENA
+        MMIO32(DWT_CTRL) |= 1; // CYCCNTENA
+    }
+
+    // startSweep starts one spectrum sweep from first by step for count steps, it returns
+    // immediately and the TIM2 interrupt performs the steps, see sweeping. It stores the samples
+    // in the provided buffer in the form -2*rssi, e.g., for -109dBm it stores 238.
+    // The speed of the sweep is govered by usDelay, which is the number of microseconds between
+    // steps, i.e. between setting the frequency and reading the RSSI value, the first step
+    // waits 100 times longer for the radio to settle on the first frequency.
+    private: void startSweep(RF& rf, uint32_t first, uint32_t step, int count, uint8_t usDelay, uint8_t buf[]) {
+        _rf = &rf;
+        _first = _freq = first;
+        _step = step;
+        _buf = buf;
+        _count = count;
+        _x = 0;
+        _period = usDelay > 13 ? usDelay : 13; // setting the freq and reading RSSI takes ~13us
+        _sweeping = true;
+        stats.frfBytes = 0;
+        active = this;
+        sweepIsr = isr;
+
+        setFreq(rf, first);
+        MMIO32(TIM2_CR1) = 0;
+        MMIO32(TIM2_PSC) = 72-1; // 1MHz
+        MMIO32(TIM2_ARR) = 100*_period - 1;
+        MMIO32(TIM2_CNT) = 0;
+        MMIO32(TIM2_EGR) = 1; // UG: load PSC
+        MMIO32(TIM2_SR) = 0;
+        MMIO32(TIM2_DIER) = 1; // UIE
+        MMIO32(TIM2_CR1) = 1; // CEN
+    }
+
+    // sweeping returns true while a sweep started by startSweep is in progress.
+    private: bool sweeping () const { return _sweeping; }
+
+    // tick performs one step of a sweep from the TIM2 interrupt.
+    private: void tick () {
+        MMIO32(TIM2_SR) = 0; // clear UIF
+        uint32_t now = MMIO32(DWT_CYCCNT);
+        if (_x == 0) {
+            MMIO32(TIM2_ARR) = _period - 1; // settled, step at the regular rate from now on
+            stats.minCycles = ~0;
+            stats.maxCycles = 0;
+            _start = now;
+        } else {
+            uint32_t d = now - _last;
+            if (d < stats.minCycles) stats.minCycles = d;
+            if (d > stats.maxCycles) stats.maxCycles = d;
+        }
+        _last = now;
+
+        // set next freq before reading RSSI, gains a few us and doesn't seem to
+        // affect the RSSI that is in the pipeline...
+        _freq += _step;
+        setFreq(*_rf, _freq);
+        _buf[_x++] = _rf->readReg(_rf->REG_RSSIVALUE);
+
+        if (_x == _count) {
+            MMIO32(TIM2_CR1) = 0;
+            MMIO32(TIM2_DIER) = 0;
+            setFreq(*_rf, _first); // step back takes longer, so start now
+            stats.steps = _x;
+            stats.cycles = now - _start;
+            _sweeping = false;
+        } else if (MMIO32(TIM2_SR) & 1) {
+            stats.overruns++; // the next step is already due
         }
-        setFreq(rf, first); // step back takes longer, so start now
     }
 
+    private: static void isr () { active->tick(); }
+
+    private: RF* _rf;
+    private: uint8_t* _buf;
+    private: uint32_t _first, _freq, _step;
+    private: uint32_t _frf = ~0; // last FRF written
+    private: uint32_t _start, _last;
+    private: int _count, _x;
+    private: uint16_t _period;
+    private: volatile bool _sweeping;
+    private: static waterfall* active;
+    private: static uint16_t pixelRows[2][LCD::width];
+    private: int pixelCur = 0;
+
     private: void dumpRow(int count, uint8_t buf[]) {
         for (int x = 0; x < count; ++x) {
             printf(" %d", buf[x]);
@@ -167,7 +287,9 @@ class waterfall {
         }
 
         int bwConfig = wfConfigs[which].bwConf;
+        initSweepTimer();
         initRadio(rf, bwConfig, center);
+        _frf = ~0; // unknown after the reset, the first setFreq writes all bytes
         rf.setMode(rf.MODE_RECEIVE);
         dumpRadioRegs(rf);
         wait_ms(10);
@@ -179,10 +301,16 @@ class waterfall {
                 center / 1000, dF/1000, (center-dF)/1000, (center+dF)/1000,
                 bwConfigs[bwConfig].fdev*61, step*61);
 
-            static uint8_t rssiRow[lcd.width];
+            // rows are double-buffered: the radio sweeps into one while the other is rendered
+            static uint8_t rssiRows[2][lcd.width];
+            int cur = 0;
+            startSweep(rf, first, step, lcd.width, bwConfigs[bwConfig].delay, rssiRows[cur]);
 
             for (int y = 16; y < lcd.height; ++y) {
-                // sanity checks
+                while (sweeping())
+                    __asm("wfi");
+
+                // sanity checks, the radio is idle between sweeps
                 uint8_t mode = rf.readReg(rf.REG_OPMODE);
                 if (mode != rf.MODE_RECEIVE) {
                     printf("OOPS: mode=%02x\r\n", mode);
@@ -192,18 +320,35 @@ class waterfall {
                     printf("OOPS: irq1=%02x\r\n", irq1);
                 }
 
-                sweepRadio(rf, first, step, lcd.width, bwConfigs[bwConfig].delay, rssiRow);
+                uint8_t* rssiRow = rssiRows[cur];
+                cur ^= 1;
+                if (y+1 < lcd.height)
+                    startSweep(rf, first, step, lcd.width, bwConfigs[bwConfig].delay, rssiRows[cur]);
+
                 //dumpRow(lcd.width, rssiRow);
                 sweepDisplay(lcd, y, lcd.width, rssiRow);
                 //packetDump(lcd.width, rssiRow);
                 //statsPrint(lcd.width, rssiRow, center-dF, step*61);
 
-                if (nextMode()) { return; }
+                if (nextMode()) {
+                    while (sweeping()) ;
+                    PUSH::wait();
+                    return;
+                }
             }
 
             printf("screen=%dms sweep=%dms step=%dus\r\n",
                 ticks - start, (ticks-start)/lcd.height, (ticks-start)*1000/lcd.height/lcd.width);
+            printf("steps/s=%d jitter=%dns (%d..%d cycles) overruns=%d frf=%d.%02d bytes/step\r\n",
+                stats.stepRate(), stats.jitterNs(), stats.minCycles, stats.maxCycles,
+                stats.overruns, stats.frfBytes / stats.steps, stats.frfBytes * 100 / stats.steps % 100);
         }
     }
 
 };
+
+template <typename RF, typename LCD, typename PUSH>
+waterfall<RF, LCD, PUSH>* waterfall<RF, LCD, PUSH>::active;
+
+template <typename RF, typename LCD, typename PUSH>
+uint16_t waterfall<RF, LCD, PUSH>::pixelRows[2][LCD::width];